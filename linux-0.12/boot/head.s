@@ -12,7 +12,7 @@
  * the page directory.
  */
 .text
-.globl _idt,_gdt,_pg_dir,_tmp_floppy_area
+.globl _idt,_gdt,_pg_dir,_tmp_floppy_area,_empty_zero_page
 _pg_dir:
 startup_32:
 	movl $0x10,%eax
@@ -108,8 +108,8 @@ setup_gdt:
 
 /*
  * I put the kernel page tables right after the page directory,
- * using 4 of them to span 16 Mb of physical memory. People with
- * more than 16MB will have to expand this.
+ * using 4 of them to span 16 Mb of physical memory. If there is
+ * more, mem_init() makes page tables for the rest (up to 1Gb).
  */
 .org 0x1000
 pg0:
@@ -124,6 +124,13 @@ pg2:
 pg3:
 
 .org 0x5000
+/*
+ * empty_zero_page is mapped read-only wherever anonymous memory is
+ * read before it is written. It's below 1Mb, so nobody counts it.
+ */
+_empty_zero_page:
+
+.org 0x6000
 /*
  * tmp_floppy_area is used by the floppy-driver when DMA cannot
  * reach to a buffer-block. It needs to be aligned, so that it isn't
@@ -185,14 +192,11 @@ ignore_int:
  * will be mapped to some other place - mm keeps track of
  * that.
  *
- * For those with more memory than 16 Mb - tough luck. I've
- * not got it, why should you :-) The source is here. Change
- * it. (Seriously - it shouldn't be too difficult. Mostly
- * change some constants etc. I left it at 16Mb, as my machine
- * even cannot be extended past that (ok, but it was cheap :-)
- * I've tried to show which constants to change by having
- * some kind of marker at them (search for "16Mb"), but I
- * won't guarantee that's all :-( )
+ * Memory above 16 Mb is mapped later on by mem_init(), which
+ * knows how much there is: the 16Mb here are enough to get the
+ * kernel going. The kernel segments below cover 1Gb: the
+ * kernel part of the page directories, below TASK_BASE, where
+ * all the memory we can use is mapped.
  */
 .align 2
 setup_paging:
@@ -225,14 +229,14 @@ idt_descr:
 .align 2
 .word 0
 gdt_descr:
-	.word 256*8-1		# so does gdt (not that that's any
-	.long _gdt		# magic number, but it works for me :^)
+	.word 260*8-1		# gdt has room for 128 tasks (not that that's
+	.long _gdt		# any magic number, but it works for me :^)
 
 	.align 3
 _idt:	.fill 256,8,0		# idt is uninitialized
 
 _gdt:	.quad 0x0000000000000000	/* NULL descriptor */
-	.quad 0x00c09a0000000fff	/* 16Mb */
-	.quad 0x00c0920000000fff	/* 16Mb */
+	.quad 0x00c39a000000ffff	/* 1Gb */
+	.quad 0x00c392000000ffff	/* 1Gb */
 	.quad 0x0000000000000000	/* TEMPORARY - don't use */
-	.fill 252,8,0			/* space for LDT's and TSS's etc */
+	.fill 256,8,0			/* space for LDT's and TSS's etc */
@@ -59,7 +59,7 @@ int free_block(int dev, int block)
 			brelse(bh);
 			return 0;
 		}
-		bh->b_dirt=0;
+		mark_buffer_clean(bh);
 		bh->b_uptodate=0;
 		if (bh->b_count)
 			brelse(bh);
@@ -69,7 +69,7 @@ int free_block(int dev, int block)
 		printk("block (%04x:%d) ",dev,block+sb->s_firstdatazone-1);
 		printk("free_block: bit already cleared\n");
 	}
-	sb->s_zmap[block/8192]->b_dirt = 1;
+	mark_buffer_dirty(sb->s_zmap[block/8192]);
 	return 1;
 }
 
@@ -90,7 +90,7 @@ int new_block(int dev)
 		return 0;
 	if (set_bit(j,bh->b_data))
 		panic("new_block: bit already set");
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	j += i*8192 + sb->s_firstdatazone-1;
 	if (j >= sb->s_nzones)
 		return 0;
@@ -100,7 +100,7 @@ int new_block(int dev)
 		panic("new block: count is != 1");
 	clear_block(bh->b_data);
 	bh->b_uptodate = 1;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	return j;
 }
@@ -130,7 +130,7 @@ void free_inode(struct m_inode * inode)
 		panic("nonexistent imap in superblock");
 	if (clear_bit(inode->i_num&8191,bh->b_data))
 		printk("free_inode: bit already cleared.\n\r");
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	memset(inode,0,sizeof(*inode));
 }
 
@@ -156,7 +156,7 @@ struct m_inode * new_inode(int dev)
 	}
 	if (set_bit(j,bh->b_data))
 		panic("new_inode: bit already set");
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	inode->i_count=1;
 	inode->i_nlinks=1;
 	inode->i_dev=dev;
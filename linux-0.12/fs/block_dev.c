@@ -29,7 +29,7 @@ int block_write(int dev, long * pos, char * buf, int count)
 		size = 0x7fffffff;
 	while (count>0) {
 		if (block >= size)
-			return written?written:-EIO;
+			break;
 		chars = BLOCK_SIZE - offset;
 		if (chars > count)
 			chars=count;
@@ -39,7 +39,7 @@ int block_write(int dev, long * pos, char * buf, int count)
 			bh = breada(dev,block,block+1,block+2,-1);
 		block++;
 		if (!bh)
-			return written?written:-EIO;
+			break;
 		p = offset + bh->b_data;
 		offset = 0;
 		*pos += chars;
@@ -47,9 +47,18 @@ int block_write(int dev, long * pos, char * buf, int count)
 		count -= chars;
 		while (chars-->0)
 			*(p++) = get_fs_byte(buf++);
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse(bh);
+		balance_dirty();
 	}
+/*
+ * We don't know which files the blocks belong to, so the cached pages of
+ * a mounted device just have to go: they may be stale now.
+ */
+	if (written)
+		invalidate_dev_pages(dev);
+	if (count > 0 && !written)
+		return -EIO;
 	return written;
 }
 
@@ -19,6 +19,7 @@
  */
 
 #include <stdarg.h>
+#include <errno.h>
  
 #include <linux/config.h>
 #include <linux/sched.h>
@@ -28,10 +29,67 @@
 
 extern int end;
 struct buffer_head * start_buffer = (struct buffer_head *) &end;
-struct buffer_head * hash_table[NR_HASH];
-static struct buffer_head * free_list;
+static struct buffer_head ** hash_table;
+static int hash_bits = 0;
+static int nr_hash = 0;
+static unsigned long nr_hash_lookups = 0;
+static unsigned long nr_hash_probes = 0;
 static struct task_struct * buffer_wait = NULL;
 int NR_BUFFERS = 0;
+int nr_buffers_dirty = 0;
+
+/*
+ * The buffer flusher. Dirty buffers used to be written only by sync()
+ * (and user-level update doing it every 30 seconds), or by getblk()
+ * when it had to steal a dirty buffer - which meant syncing a whole
+ * device in the middle of an allocation. Now a kernel task (started by
+ * init through the bdflush() system call) writes them in the background:
+ *
+ *  - every BDF_INTERVAL it writes buffers that have been dirty for more
+ *    than BDF_AGE ticks,
+ *  - when more than BDF_SOFT percent of the cache is dirty it is woken
+ *    up early, and writes the oldest buffers until we're below it,
+ *  - writers that get the cache more than BDF_HARD percent dirty are
+ *    made to wait for the flusher in balance_dirty().
+ *
+ * Each round is written in batches sorted by device and block, so the
+ * requests arrive at the elevator in a nice order.
+ */
+#define BDF_INTERVAL	(5*HZ)
+#define BDF_AGE		(30*HZ)
+#define BDF_SOFT	30
+#define BDF_HARD	60
+#define BDF_BATCH	64
+
+static struct task_struct * bdflush_task = NULL;
+static struct task_struct * bdflush_wait = NULL;
+static struct task_struct * bdflush_done = NULL;
+static int bdflush_force = 0;
+
+/*
+ * The cache grows and shrinks with the free memory. The buffers that
+ * buffer_init() sets up are always there, and on top of those getblk()
+ * takes pages from get_free_page() as long as there are more than
+ * BUF_MIN_FREE of them free, instead of throwing cached blocks away.
+ * When get_free_page() runs out, it gives pages of clean buffers back
+ * through shrink_buffers() before it starts swapping.
+ *
+ * The buffers of one page are linked through b_this_page. Buffer heads
+ * are never freed, as sync() and friends sleep in the middle of walking
+ * them: the heads of a page that is given back go on the unused_heads
+ * list, linked through b_next.
+ */
+#define BUF_PER_PAGE	(PAGE_SIZE/BLOCK_SIZE)
+#define BUF_MAX		50	/* percent of the free memory at boot */
+#define BUF_MIN_FREE	64	/* pages */
+
+static struct buffer_head * all_buffers = NULL;
+static struct buffer_head * unused_heads = NULL;
+static int nr_unused_heads = 0;
+static int max_buffers = 0;
+static int nr_buffer_pages = 0;
+static int nr_grown = 0;
+static int nr_shrunk = 0;
 
 static inline void wait_on_buffer(struct buffer_head * bh)
 {
@@ -43,12 +101,10 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 
 int sys_sync(void)
 {
-	int i;
 	struct buffer_head * bh;
 
 	sync_inodes();		/* write out inodes into buffers */
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
+	for (bh = all_buffers ; bh ; bh = bh->b_next_all) {
 		wait_on_buffer(bh);
 		if (bh->b_dirt)
 			ll_rw_block(WRITE,bh);
@@ -58,11 +114,9 @@ int sys_sync(void)
 
 int sync_dev(int dev)
 {
-	int i;
 	struct buffer_head * bh;
 
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
+	for (bh = all_buffers ; bh ; bh = bh->b_next_all) {
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
@@ -70,8 +124,7 @@ int sync_dev(int dev)
 			ll_rw_block(WRITE,bh);
 	}
 	sync_inodes();
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
+	for (bh = all_buffers ; bh ; bh = bh->b_next_all) {
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
@@ -83,16 +136,16 @@ int sync_dev(int dev)
 
 void inline invalidate_buffers(int dev)
 {
-	int i;
 	struct buffer_head * bh;
 
-	bh = start_buffer;
-	for (i=0 ; i<NR_BUFFERS ; i++,bh++) {
+	for (bh = all_buffers ; bh ; bh = bh->b_next_all) {
 		if (bh->b_dev != dev)
 			continue;
 		wait_on_buffer(bh);
-		if (bh->b_dev == dev)
-			bh->b_uptodate = bh->b_dirt = 0;
+		if (bh->b_dev == dev) {
+			bh->b_uptodate = 0;
+			mark_buffer_clean(bh);
+		}
 	}
 }
 
@@ -123,11 +176,175 @@ void check_disk_change(int dev)
 			put_super(super_block[i].s_dev);
 	invalidate_inodes(dev);
 	invalidate_buffers(dev);
+	invalidate_dev_pages(dev);
 }
 
-#define _hashfn(dev,block) (((unsigned)(dev^block))%NR_HASH)
+/*
+ * Multiplicative hashing (Knuth): multiplying by the golden ratio and
+ * keeping the top bits scatters neighbouring blocks over the table, and
+ * putting the device in the high half keeps the same block numbers on
+ * different devices apart. The table is a power of two, sized in
+ * buffer_init() from the number of buffers.
+ */
+#define _hashfn(dev,block) \
+	((((unsigned long)(block) ^ ((unsigned long)(dev)<<16)) * \
+	0x9E3779B1UL) >> (32-hash_bits))
 #define hash(dev,block) hash_table[_hashfn(dev,block)]
 
+/*
+ * The free buffers (b_count == 0) are kept on three LRU lists, oldest
+ * first: clean, dirty and locked. A buffer is put on the right list
+ * when its last user lets go of it, and taken off again when it gets a
+ * user. Buffers that are in use aren't on any list. This way getblk()
+ * can take the head of the clean list instead of looking at every
+ * buffer in the cache, and never has to step over the dirty ones.
+ *
+ * Writes complete at interrupt time, and we don't want to muck with the
+ * lists there: finished buffers stay on the locked list until getblk()
+ * runs out of clean ones and moves them over.
+ */
+static struct buffer_head * lru_list[NR_LIST] = {NULL, };
+static int nr_lru_takes = 0;		/* getblk()s served from the clean list */
+static int nr_lru_refiles = 0;		/* locked buffers moved after their io */
+static int nr_lru_waits = 0;		/* getblk()s that had to wait */
+
+static inline void remove_from_lru(struct buffer_head * bh)
+{
+	if (!bh->b_next_free)
+		return;
+	if (bh->b_next_free == bh)
+		lru_list[bh->b_list] = NULL;
+	else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		if (lru_list[bh->b_list] == bh)
+			lru_list[bh->b_list] = bh->b_next_free;
+	}
+	bh->b_next_free = bh->b_prev_free = NULL;
+}
+
+static inline void insert_into_lru(struct buffer_head * bh, int list)
+{
+	struct buffer_head * head;
+
+	bh->b_list = list;
+	if (!(head = lru_list[list])) {
+		lru_list[list] = bh->b_next_free = bh->b_prev_free = bh;
+		return;
+	}
+/* put at end of list: it's the most recently used */
+	bh->b_next_free = head;
+	bh->b_prev_free = head->b_prev_free;
+	head->b_prev_free->b_next_free = bh;
+	head->b_prev_free = bh;
+}
+
+/*
+ * refile_buffer() puts an unused buffer on the list matching its state.
+ * It doesn't sleep, and is called from add_request() with interrupts off.
+ */
+static void refile_buffer(struct buffer_head * bh)
+{
+	int list;
+
+	if (bh->b_count)
+		return;
+	if (bh->b_lock)
+		list = BUF_LOCKED;
+	else if (bh->b_dirt)
+		list = BUF_DIRTY;
+	else
+		list = BUF_CLEAN;
+	if (bh->b_next_free && bh->b_list == list)
+		return;
+	remove_from_lru(bh);
+	insert_into_lru(bh,list);
+}
+
+/*
+ * Move the buffers whose io has finished from the locked list to
+ * where they belong now.
+ */
+static void refile_locked(void)
+{
+	struct buffer_head * bh, * next;
+	int n = 0;
+
+	if (!(bh = lru_list[BUF_LOCKED]))
+		return;
+	do
+		n++;
+	while ((bh = bh->b_next_free) != lru_list[BUF_LOCKED]);
+	while (n-- > 0) {
+		next = bh->b_next_free;
+		if (!bh->b_lock) {
+			refile_buffer(bh);
+			nr_lru_refiles++;
+		}
+		bh = next;
+	}
+}
+
+/*
+ * get_more_heads() adds a page worth of buffer heads to unused_heads.
+ * get_free_page() has cleared it for us.
+ */
+static int get_more_heads(void)
+{
+	struct buffer_head * bh;
+	int i;
+
+	if (!(bh = (struct buffer_head *) get_free_page()))
+		return 0;
+	for (i = PAGE_SIZE/sizeof(struct buffer_head) ; i-- > 0 ; bh++) {
+		bh->b_next_all = all_buffers;
+		all_buffers = bh;
+		bh->b_next = unused_heads;
+		unused_heads = bh;
+		nr_unused_heads++;
+	}
+	return 1;
+}
+
+/*
+ * grow_buffers() adds a page of new buffers to the front of the clean
+ * list, if memory allows. It doesn't sleep: with BUF_MIN_FREE pages
+ * free, get_free_page() never has to swap.
+ */
+static int grow_buffers(void)
+{
+	struct buffer_head * bh, * first = NULL, * last = NULL;
+	unsigned long page;
+	int i;
+
+	if (NR_BUFFERS + BUF_PER_PAGE > max_buffers)
+		return 0;
+	if (nr_free_pages < BUF_MIN_FREE)
+		return 0;
+	if (nr_unused_heads < BUF_PER_PAGE && !get_more_heads())
+		return 0;
+	if (!(page = get_free_page()))
+		return 0;
+	for (i=0 ; i<BUF_PER_PAGE ; i++) {
+		bh = unused_heads;
+		unused_heads = bh->b_next;
+		nr_unused_heads--;
+		bh->b_next = NULL;
+		bh->b_data = (char *) (page + i*BLOCK_SIZE);
+		bh->b_this_page = first;
+		if (!last)
+			last = bh;
+		first = bh;
+		insert_into_lru(bh,BUF_CLEAN);
+		lru_list[BUF_CLEAN] = bh;
+	}
+	last->b_this_page = first;
+	NR_BUFFERS += BUF_PER_PAGE;
+	nr_buffer_pages++;
+	nr_grown++;
+	return 1;
+}
+
 static inline void remove_from_queues(struct buffer_head * bh)
 {
 /* remove from hash-queue */
@@ -137,22 +354,10 @@ static inline void remove_from_queues(struct buffer_head * bh)
 		bh->b_prev->b_next = bh->b_next;
 	if (hash(bh->b_dev,bh->b_blocknr) == bh)
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
-/* remove from free list */
-	if (!(bh->b_prev_free) || !(bh->b_next_free))
-		panic("Free block list corrupted");
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	if (free_list == bh)
-		free_list = bh->b_next_free;
 }
 
 static inline void insert_into_queues(struct buffer_head * bh)
 {
-/* put at end of free list */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
 /* put the buffer in new hash-queue if it has a device */
 	bh->b_prev = NULL;
 	bh->b_next = NULL;
@@ -160,19 +365,89 @@ static inline void insert_into_queues(struct buffer_head * bh)
 		return;
 	bh->b_next = hash(bh->b_dev,bh->b_blocknr);
 	hash(bh->b_dev,bh->b_blocknr) = bh;
-	bh->b_next->b_prev = bh;
+	if (bh->b_next)
+		bh->b_next->b_prev = bh;
 }
 
 static struct buffer_head * find_buffer(int dev, int block)
 {		
 	struct buffer_head * tmp;
 
-	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next)
+	nr_hash_lookups++;
+	for (tmp = hash(dev,block) ; tmp != NULL ; tmp = tmp->b_next) {
+		nr_hash_probes++;
 		if (tmp->b_dev==dev && tmp->b_blocknr==block)
 			return tmp;
+	}
 	return NULL;
 }
 
+/*
+ * A page can be given back when none of its buffers is used, locked or
+ * dirty. The buffers from buffer_init() aren't in pages of their own.
+ */
+static int buffer_page_free(struct buffer_head * bh)
+{
+	struct buffer_head * tmp = bh;
+
+	if (!bh->b_this_page)
+		return 0;
+	do {
+		if (tmp->b_count || tmp->b_lock || tmp->b_dirt)
+			return 0;
+	} while ((tmp = tmp->b_this_page) != bh);
+	return 1;
+}
+
+static void free_buffer_page(struct buffer_head * bh)
+{
+	struct buffer_head * next;
+	unsigned long page = (unsigned long) bh->b_data & 0xfffff000;
+	int i;
+
+	for (i=0 ; i<BUF_PER_PAGE ; i++,bh = next) {
+		next = bh->b_this_page;
+		remove_from_lru(bh);
+		remove_from_queues(bh);
+		bh->b_dev = 0;
+		bh->b_uptodate = 0;
+		bh->b_data = NULL;
+		bh->b_this_page = NULL;
+		bh->b_prev = NULL;
+		bh->b_next = unused_heads;
+		unused_heads = bh;
+		nr_unused_heads++;
+	}
+	free_page(page);
+	NR_BUFFERS -= BUF_PER_PAGE;
+	nr_buffer_pages--;
+	nr_shrunk++;
+}
+
+/*
+ * shrink_buffers() is called by get_free_page() when it runs out of
+ * memory. It gives back up to 'pages' pages of the oldest clean
+ * buffers, and returns how many it found. It doesn't sleep.
+ */
+int shrink_buffers(int pages)
+{
+	struct buffer_head * bh;
+	int n, freed = 0;
+
+	refile_locked();
+	bh = lru_list[BUF_CLEAN];
+	for (n = NR_BUFFERS ; bh && n > 0 && freed < pages ; n--) {
+		if (!buffer_page_free(bh)) {
+			bh = bh->b_next_free;
+			continue;
+		}
+		free_buffer_page(bh);
+		freed++;
+		bh = lru_list[BUF_CLEAN];
+	}
+	return freed;
+}
+
 /*
  * Why like this, I hear you say... The reason is race-conditions.
  * As we don't lock buffers (unless we are readint them, that is),
@@ -187,11 +462,13 @@ struct buffer_head * get_hash_table(int dev, int block)
 	for (;;) {
 		if (!(bh=find_buffer(dev,block)))
 			return NULL;
-		bh->b_count++;
+		if (!bh->b_count++)
+			remove_from_lru(bh);
 		wait_on_buffer(bh);
 		if (bh->b_dev == dev && bh->b_blocknr == block)
 			return bh;
-		bh->b_count--;
+		if (!--bh->b_count)
+			refile_buffer(bh);
 	}
 }
 
@@ -200,48 +477,55 @@ struct buffer_head * get_hash_table(int dev, int block)
  * race-conditions. Most of the code is seldom used, (ie repeating),
  * so it should be much more efficient than it looks.
  *
- * The algoritm is changed: hopefully better, and an elusive bug removed.
+ * The algoritm is changed again: the oldest clean buffer is simply the
+ * head of the clean list. If there is none, we wait for some dirty or
+ * locked buffer to become clean, and try again.
  */
-#define BADNESS(bh) (((bh)->b_dirt<<1)+(bh)->b_lock)
 struct buffer_head * getblk(int dev,int block)
 {
-	struct buffer_head * tmp, * bh;
+	struct buffer_head * bh;
 
 repeat:
 	if (bh = get_hash_table(dev,block))
 		return bh;
-	tmp = free_list;
-	do {
-		if (tmp->b_count)
-			continue;
-		if (!bh || BADNESS(tmp)<BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp))
-				break;
-		}
-/* and repeat until we find something good */
-	} while ((tmp = tmp->b_next_free) != free_list);
+	if (!lru_list[BUF_CLEAN])
+		refile_locked();
+/* rather than throw a cached block away, grow the cache if we can */
+	if ((!(bh = lru_list[BUF_CLEAN]) || bh->b_dev) && grow_buffers())
+		bh = lru_list[BUF_CLEAN];
 	if (!bh) {
-		sleep_on(&buffer_wait);
+		nr_lru_waits++;
+		if (bh = lru_list[BUF_DIRTY]) {
+/*
+ * Only dirty buffers left: let the flusher do the writing, we just wait.
+ * With a signal pending we write one ourselves, so that a flusher that
+ * gets nowhere can't keep us here for ever.
+ */
+			if (bdflush_task && bdflush_task != current &&
+			    !(current->signal & ~current->blocked)) {
+				bdflush_force = 1;
+				wake_up(&bdflush_wait);
+				interruptible_sleep_on(&bdflush_done);
+				goto repeat;
+			}
+			ll_rw_block(WRITE,bh);
+		} else
+			bh = lru_list[BUF_LOCKED];
+		if (bh)
+			wait_on_buffer(bh);
+		else
+			sleep_on(&buffer_wait);
 		goto repeat;
 	}
-	wait_on_buffer(bh);
-	if (bh->b_count)
+	if (bh->b_lock || bh->b_dirt) {
+		refile_buffer(bh);
 		goto repeat;
-	while (bh->b_dirt) {
-		sync_dev(bh->b_dev);
-		wait_on_buffer(bh);
-		if (bh->b_count)
-			goto repeat;
 	}
-/* NOTE!! While we slept waiting for this block, somebody else might */
-/* already have added "this" block to the cache. check it */
-	if (find_buffer(dev,block))
-		goto repeat;
 /* OK, FINALLY we know that this buffer is the only one of it's kind, */
 /* and that it's unused (b_count=0), unlocked (b_lock=0), and clean */
+	nr_lru_takes++;
+	remove_from_lru(bh);
 	bh->b_count=1;
-	bh->b_dirt=0;
 	bh->b_uptodate=0;
 	remove_from_queues(bh);
 	bh->b_dev=dev;
@@ -250,6 +534,47 @@ repeat:
 	return bh;
 }
 
+void mark_buffer_dirty(struct buffer_head * bh)
+{
+	if (bh->b_dirt)
+		return;
+	bh->b_dirt = 1;
+	bh->b_dirttime = jiffies;
+	refile_buffer(bh);
+	if (++nr_buffers_dirty > NR_BUFFERS*BDF_SOFT/100)
+		wake_up(&bdflush_wait);
+}
+
+/*
+ * NOTE! This is called from add_request() with interrupts off, so it
+ * mustn't sleep.
+ */
+void mark_buffer_clean(struct buffer_head * bh)
+{
+	if (!bh->b_dirt)
+		return;
+	bh->b_dirt = 0;
+	bh->b_dirttime = 0;
+	refile_buffer(bh);
+	nr_buffers_dirty--;
+}
+
+/*
+ * balance_dirty() is called by the writers after they have dirtied a
+ * buffer. If too much of the cache is dirty, wait for the flusher to
+ * catch up, unless a signal comes first.
+ */
+void balance_dirty(void)
+{
+	while (bdflush_task && bdflush_task != current &&
+	    nr_buffers_dirty > NR_BUFFERS*BDF_HARD/100 &&
+	    !(current->signal & ~current->blocked)) {
+		bdflush_force = 1;
+		wake_up(&bdflush_wait);
+		interruptible_sleep_on(&bdflush_done);
+	}
+}
+
 void brelse(struct buffer_head * buf)
 {
 	if (!buf)
@@ -257,6 +582,7 @@ void brelse(struct buffer_head * buf)
 	wait_on_buffer(buf);
 	if (!(buf->b_count--))
 		panic("Trying to free free buffer");
+	refile_buffer(buf);
 	wake_up(&buffer_wait);
 }
 
@@ -314,6 +640,22 @@ void bread_page(unsigned long address,int dev,int b[4])
 		}
 }
 
+/*
+ * bread_ahead() starts reading a block into the buffer cache, but doesn't
+ * wait for it (nor hold on to the buffer).
+ */
+void bread_ahead(int dev,int block)
+{
+	struct buffer_head * bh;
+
+	if (!(bh=getblk(dev,block)))
+		return;
+	if (!bh->b_uptodate)
+		ll_rw_block(READA,bh);
+	if (!--bh->b_count)
+		refile_buffer(bh);
+}
+
 /*
  * Ok, breada can be used as bread, but additionally to mark other
  * blocks for reading as well. End the argument list with a negative
@@ -322,21 +664,15 @@ void bread_page(unsigned long address,int dev,int b[4])
 struct buffer_head * breada(int dev,int first, ...)
 {
 	va_list args;
-	struct buffer_head * bh, *tmp;
+	struct buffer_head * bh;
 
 	va_start(args,first);
 	if (!(bh=getblk(dev,first)))
 		panic("bread: getblk returned NULL\n");
 	if (!bh->b_uptodate)
 		ll_rw_block(READ,bh);
-	while ((first=va_arg(args,int))>=0) {
-		tmp=getblk(dev,first);
-		if (tmp) {
-			if (!tmp->b_uptodate)
-				ll_rw_block(READA,bh);
-			tmp->b_count--;
-		}
-	}
+	while ((first=va_arg(args,int))>=0)
+		bread_ahead(dev,first);
 	va_end(args);
 	wait_on_buffer(bh);
 	if (bh->b_uptodate)
@@ -345,37 +681,190 @@ struct buffer_head * breada(int dev,int first, ...)
 	return (NULL);
 }
 
+/*
+ * flush_buffers() does one round of the flusher: it takes the dirty
+ * buffers from the front of the dirty list, where the ones left alone
+ * longest are, until it gets to one that isn't old enough (if too much
+ * is dirty or somebody is waiting for clean buffers, it simply takes the
+ * oldest ones), sorts them by device and block number and starts
+ * writing them. It doesn't wait for the writes to finish. Buffers that
+ * are in use aren't on the list: they get there when they're released,
+ * and sync() writes them anyway.
+ */
+static void flush_buffers(int force)
+{
+	struct buffer_head * batch[BDF_BATCH];
+	struct buffer_head * bh, * tmp;
+	int i, j, n;
+
+repeat:
+	if (nr_buffers_dirty > NR_BUFFERS*BDF_SOFT/100)
+		force = 1;
+	refile_locked();
+	n = 0;
+	if (bh = lru_list[BUF_DIRTY])
+		do {
+			if (!force && jiffies - bh->b_dirttime < BDF_AGE)
+				break;
+			batch[n++] = bh;
+		} while (n < BDF_BATCH &&
+		    (bh = bh->b_next_free) != lru_list[BUF_DIRTY]);
+	if (!n)
+		return;
+/* straight insertion sort: n is small */
+	for (i=1 ; i<n ; i++) {
+		tmp = batch[i];
+		for (j=i ; j>0 ; j--) {
+			bh = batch[j-1];
+			if (bh->b_dev < tmp->b_dev || (bh->b_dev == tmp->b_dev &&
+			    bh->b_blocknr < tmp->b_blocknr))
+				break;
+			batch[j] = bh;
+		}
+		batch[j] = tmp;
+	}
+	for (i=0 ; i<n ; i++)
+		ll_rw_block(WRITE,batch[i]);
+	if (n == BDF_BATCH || nr_buffers_dirty > NR_BUFFERS*BDF_SOFT/100) {
+		force = 0;
+		goto repeat;
+	}
+}
+
+/*
+ * sys_bdflush() turns the calling process into the buffer flusher: init
+ * forks a child that calls it at boot. All the signals but SIGKILL are
+ * blocked - even SIGSTOP, as nothing would write the buffers meanwhile -
+ * and SIGKILL makes it return, after waking the writers that wait for it.
+ */
+int sys_bdflush(void)
+{
+	int force;
+
+	if (!suser())
+		return -EPERM;
+	if (bdflush_task)
+		return -EBUSY;
+	bdflush_task = current;
+	current->blocked = ~(1<<(SIGKILL-1));
+	for (;;) {
+		sync_inodes();
+		force = bdflush_force;
+		bdflush_force = 0;
+		flush_buffers(force);
+		wake_up(&bdflush_done);
+		if (current->signal & ~current->blocked)
+			break;
+/* blocked signals never get to us, and a SIGSTOP would keep waking us up */
+		current->signal &= ~current->blocked;
+		current->timeout = jiffies + BDF_INTERVAL;
+		interruptible_sleep_on(&bdflush_wait);
+		current->timeout = 0;
+	}
+	bdflush_task = NULL;
+	wake_up(&bdflush_done);
+	return -EINTR;
+}
+
 void buffer_init(long buffer_end)
 {
-	struct buffer_head * h = start_buffer;
+	struct buffer_head * h;
 	void * b;
-	int i;
+	long size;
+	int i, order;
 
 	if (buffer_end == 1<<20)
 		b = (void *) (640*1024);
 	else
 		b = (void *) buffer_end;
+/*
+ * The hash table gets pages of its own (mem_init() has been called): it
+ * grows with memory, and below 640kB it would leave no room for buffers,
+ * or run past 1Mb. Guess how many buffers we'll get here, add what the
+ * cache may grow to, and make it the next power of two, so that the
+ * chains are about one buffer long - as far as one get_free_pages() goes.
+ */
+	size = (long) b - (long) &end;
+	if ((long) b > 0x100000)
+		size -= 0x100000 - 0xA0000;
+	size /= BLOCK_SIZE + sizeof(struct buffer_head);
+	size += nr_free_pages*BUF_MAX/100*BUF_PER_PAGE;
+	for (hash_bits = MIN_HASH_BITS ; (1<<hash_bits) < size ; hash_bits++)
+		/* nothing */ ;
+	while ((sizeof(struct buffer_head *) << hash_bits) >
+	    (PAGE_SIZE << (NR_MEM_ORDERS-1)))
+		hash_bits--;
+	nr_hash = 1<<hash_bits;
+	for (order = 0 ; (PAGE_SIZE << order) < nr_hash*sizeof(struct buffer_head *) ;
+	    order++)
+		/* nothing */ ;
+	if (!(hash_table = (struct buffer_head **) get_free_pages(order)))
+		panic("Unable to get the buffer hash table");
+	for (i=0;i<nr_hash;i++)
+		hash_table[i]=NULL;
+	start_buffer = h = (struct buffer_head *) &end;
 	while ( (b -= BLOCK_SIZE) >= ((void *) (h+1)) ) {
 		h->b_dev = 0;
 		h->b_dirt = 0;
 		h->b_count = 0;
 		h->b_lock = 0;
 		h->b_uptodate = 0;
+		h->b_dirttime = 0;
 		h->b_wait = NULL;
 		h->b_next = NULL;
 		h->b_prev = NULL;
 		h->b_data = (char *) b;
 		h->b_prev_free = h-1;
 		h->b_next_free = h+1;
+		h->b_list = BUF_CLEAN;
+		h->b_this_page = NULL;
+		h->b_next_all = all_buffers;
+		all_buffers = h;
 		h++;
 		NR_BUFFERS++;
 		if (b == (void *) 0x100000)
 			b = (void *) 0xA0000;
 	}
 	h--;
-	free_list = start_buffer;
-	free_list->b_prev_free = h;
-	h->b_next_free = free_list;
-	for (i=0;i<NR_HASH;i++)
-		hash_table[i]=NULL;
+	lru_list[BUF_CLEAN] = start_buffer;
+	start_buffer->b_prev_free = h;
+	h->b_next_free = start_buffer;
+	max_buffers = NR_BUFFERS + nr_free_pages*BUF_MAX/100*BUF_PER_PAGE;
 }	
+
+void show_buffers(void)
+{
+	static char * list_name[NR_LIST] = {"clean","dirty","locked"};
+	struct buffer_head * bh;
+	int i, n, free = 0;
+	int used, longest;
+
+	printk("Buffer-info:\n\r");
+	for (i=0 ; i<NR_LIST ; i++) {
+		n = 0;
+		if (bh = lru_list[i])
+			do
+				n++;
+			while ((bh = bh->b_next_free) != lru_list[i]);
+		printk("%d %s, ",n,list_name[i]);
+		free += n;
+	}
+	printk("%d in use of %d buffers (%d dirty)\n\r",NR_BUFFERS-free,
+		NR_BUFFERS,nr_buffers_dirty);
+	printk("%d extra pages (max %d buffers): %d grown, %d given back\n\r",
+		nr_buffer_pages,max_buffers,nr_grown,nr_shrunk);
+	printk("%d getblk()s without a scan, %d refiled, %d waited\n\r",
+		nr_lru_takes,nr_lru_refiles,nr_lru_waits);
+	used = longest = 0;
+	for (i=0 ; i<nr_hash ; i++) {
+		n = 0;
+		for (bh = hash_table[i] ; bh ; bh = bh->b_next)
+			n++;
+		if (n)
+			used++;
+		if (n > longest)
+			longest = n;
+	}
+	printk("Hash: %d chains, %d used, longest %d, %d probes/%d lookups\n\r",
+		nr_hash,used,longest,nr_hash_probes,nr_hash_lookups);
+}
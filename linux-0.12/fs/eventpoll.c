@@ -0,0 +1,466 @@
+/*
+ *  linux/fs/eventpoll.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * eventpoll.c does epoll_create(), epoll_ctl() and epoll_wait(). select()
+ * looks at every file it's given each time it wakes up, and puts itself
+ * on all their wait queues again. An epoll file instead keeps the list of
+ * files it's interested in, and each item of it watches the wait queues
+ * of its pipe or tty until it's removed. wake_up() on one of those queues
+ * calls poll_wake(), which puts the items watching it on the ready list of
+ * their epoll file. epoll_wait() only looks at the ready list.
+ *
+ * Events are level-triggered: an item that is still ready once it has
+ * been reported stays on the ready list, one that isn't drops off until
+ * the next wake_up(). With EPOLLET, an item is reported once per wake_up().
+ *
+ * poll_wake() is called from interrupts too, so the ready lists and the
+ * watch table are only changed with interrupts off. Everything else is
+ * protected by the lock of the epoll file, as epoll_wait() may sleep
+ * writing out the events.
+ *
+ * epoll_wait() and epoll_ctl() use an epoll file through a fd of their
+ * own, so it can't go away under them. epoll_release() goes through all
+ * of them when some other file is closed, and may sleep on the lock of
+ * any: it holds a reference on each, and one that is closed in the
+ * meantime stays on the list, dead, until the last reference goes.
+ */
+
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <asm/segment.h>
+#include <asm/system.h>
+
+#define WATCH_HASH	64
+#define hashfn(queue) ((((unsigned long) (queue)) >> 2) % WATCH_HASH)
+
+struct epitem;
+
+struct poll_watch {
+	struct task_struct ** w_queue;	/* NULL if not watching */
+	struct epitem * w_item;
+	struct poll_watch * w_next;	/* in the watch table */
+};
+
+struct epitem {
+	struct epitem * e_next;		/* in the interest list */
+	struct epitem * e_rdnext;	/* in the ready list */
+	struct eventpoll * e_ep;
+	struct file * e_file;
+	int e_fd;
+	unsigned long e_events;
+	unsigned long e_data;
+	unsigned char e_ready;
+	struct poll_watch e_watch[2];	/* for reading and for writing */
+};
+
+struct eventpoll {
+	struct m_inode * ep_inode;
+	struct epitem * ep_items;
+	struct epitem * ep_ready, * ep_last;
+	struct task_struct * ep_wait;	/* in epoll_wait() */
+	struct task_struct * ep_lock_wait;
+	unsigned char ep_lock;
+	unsigned char ep_dead;		/* its file has been closed */
+	unsigned short ep_count;	/* references in epoll_release() */
+	struct eventpoll * ep_next;
+};
+
+static struct poll_watch * watch_table[WATCH_HASH];
+static struct eventpoll * first_ep = NULL;
+static int nr_epitems = 0;
+int poll_watches = 0;
+
+static void lock_ep(struct eventpoll * ep)
+{
+	cli();
+	while (ep->ep_lock)
+		sleep_on(&ep->ep_lock_wait);
+	ep->ep_lock = 1;
+	sti();
+}
+
+static void unlock_ep(struct eventpoll * ep)
+{
+	ep->ep_lock = 0;
+	wake_up(&ep->ep_lock_wait);
+}
+
+/* the next ones are called with interrupts off */
+static void watch(struct poll_watch * w, struct task_struct ** queue)
+{
+	if (!queue)
+		return;
+	w->w_queue = queue;
+	w->w_next = watch_table[hashfn(queue)];
+	watch_table[hashfn(queue)] = w;
+	poll_watches++;
+}
+
+static void unwatch(struct poll_watch * w)
+{
+	struct poll_watch ** p;
+
+	if (!w->w_queue)
+		return;
+	for (p = watch_table + hashfn(w->w_queue) ; *p ; p = &(*p)->w_next)
+		if (*p == w) {
+			*p = w->w_next;
+			poll_watches--;
+			break;
+		}
+	w->w_queue = NULL;
+}
+
+static void make_ready(struct epitem * e)
+{
+	struct eventpoll * ep = e->e_ep;
+
+	e->e_ready = 1;
+	e->e_rdnext = NULL;
+	if (ep->ep_last)
+		ep->ep_last->e_rdnext = e;
+	else
+		ep->ep_ready = e;
+	ep->ep_last = e;
+/* not wake_up(): that would call us again */
+	if (ep->ep_wait)
+		ep->ep_wait->state = TASK_RUNNING;
+}
+
+static void unready(struct epitem * e)
+{
+	struct eventpoll * ep = e->e_ep;
+	struct epitem ** p, * last = NULL;
+
+	if (!e->e_ready)
+		return;
+	for (p = &ep->ep_ready ; *p ; last = *p, p = &(*p)->e_rdnext)
+		if (*p == e) {
+			*p = e->e_rdnext;
+			if (ep->ep_last == e)
+				ep->ep_last = last;
+			break;
+		}
+	e->e_ready = 0;
+}
+
+/*
+ * Called by wake_up() for every queue while somebody watches any, and by
+ * the serial interrupt, which wakes its writers by hand.
+ */
+void poll_wake(struct task_struct ** queue)
+{
+	struct poll_watch * w;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	for (w = watch_table[hashfn(queue)] ; w ; w = w->w_next)
+		if (w->w_queue == queue && !w->w_item->e_ready)
+			make_ready(w->w_item);
+	restore_flags(flags);
+}
+
+/*
+ * (Re)starts watching the file of an item, and puts it on the ready list
+ * if it's ready already. The file is looked at with interrupts off, so
+ * that no wake_up() can get in between.
+ */
+static int arm_item(struct epitem * e)
+{
+	struct task_struct ** in, ** out;
+	int mask;
+
+	cli();
+	unwatch(e->e_watch);
+	unwatch(e->e_watch+1);
+	if ((mask = file_poll(e->e_file,&in,&out)) < 0) {
+		sti();
+		return -EPERM;
+	}
+	watch(e->e_watch,in);
+	watch(e->e_watch+1,out);
+	if ((mask & (e->e_events | EPOLLERR | EPOLLHUP)) && !e->e_ready)
+		make_ready(e);
+	sti();
+	return 0;
+}
+
+/* the ep has to be locked */
+static void remove_item(struct eventpoll * ep, struct epitem * e)
+{
+	struct epitem ** p;
+
+	cli();
+	unwatch(e->e_watch);
+	unwatch(e->e_watch+1);
+	unready(e);
+	sti();
+	for (p = &ep->ep_items ; *p ; p = &(*p)->e_next)
+		if (*p == e) {
+			*p = e->e_next;
+			break;
+		}
+	free_s(e,sizeof(struct epitem));
+	nr_epitems--;
+}
+
+/* drops a reference, and frees a dead ep that nobody uses any more */
+static void put_ep(struct eventpoll * ep)
+{
+	struct eventpoll ** p;
+
+	if (--ep->ep_count || !ep->ep_dead)
+		return;
+	for (p = &first_ep ; *p ; p = &(*p)->ep_next)
+		if (*p == ep) {
+			*p = ep->ep_next;
+			break;
+		}
+	free_s(ep,sizeof(struct eventpoll));
+}
+
+static struct eventpoll * get_ep(unsigned int fd)
+{
+	struct eventpoll * ep;
+	struct file * filp;
+
+	if (fd >= NR_OPEN || !(filp = current->filp[fd]))
+		return NULL;
+	for (ep = first_ep ; ep ; ep = ep->ep_next)
+		if (ep->ep_inode == filp->f_inode)
+			return ep;
+	return NULL;
+}
+
+int sys_epoll_create(int size)
+{
+	struct eventpoll * ep;
+	struct file * f;
+	int fd, i;
+
+	if (size <= 0)
+		return -EINVAL;
+/* malloc() may sleep: the fd and the file are only looked for after it */
+	if (!(ep = (struct eventpoll *) malloc(sizeof(struct eventpoll))))
+		return -ENOMEM;
+	for (fd=0 ; fd<NR_OPEN ; fd++)
+		if (!current->filp[fd])
+			break;
+	for (i=0, f=file_table ; i<NR_FILE ; i++, f++)
+		if (!f->f_count)
+			break;
+	if (fd >= NR_OPEN || i >= NR_FILE) {
+		free_s(ep,sizeof(struct eventpoll));
+		return (fd >= NR_OPEN) ? -EMFILE : -ENFILE;
+	}
+	current->filp[fd] = f;
+	f->f_count = 1;
+	current->close_on_exec &= ~(1<<fd);
+	ep->ep_inode = get_empty_inode();
+	ep->ep_items = ep->ep_ready = ep->ep_last = NULL;
+	ep->ep_wait = ep->ep_lock_wait = NULL;
+	ep->ep_lock = ep->ep_dead = 0;
+	ep->ep_count = 0;
+	ep->ep_next = first_ep;
+	first_ep = ep;
+	f->f_inode = ep->ep_inode;
+	f->f_mode = 1;
+	f->f_flags = 0;
+	f->f_pos = 0;
+	return fd;
+}
+
+int sys_epoll_ctl(unsigned long * buffer)
+{
+	struct eventpoll * ep;
+	struct epitem * e;
+	struct file * filp;
+	struct epoll_event * event;
+	unsigned long arg[4], events = 0, data = 0;
+	int i, err = 0;
+
+	for (i=0 ; i<4 ; i++)
+		arg[i] = get_fs_long(buffer+i);
+	if (!(ep = get_ep(arg[0])))
+		return -EBADF;
+	if (arg[2] >= NR_OPEN || !(filp = current->filp[arg[2]]))
+		return -EBADF;
+	if (filp->f_inode == ep->ep_inode)
+		return -EINVAL;
+	if (arg[1] != EPOLL_CTL_DEL) {
+		if (!(event = (struct epoll_event *) arg[3]))
+			return -EFAULT;
+		events = get_fs_long(&event->events);
+		data = get_fs_long(&event->data.u32);
+	}
+	lock_ep(ep);
+	for (e = ep->ep_items ; e ; e = e->e_next)
+		if (e->e_file == filp && e->e_fd == arg[2])
+			break;
+	switch (arg[1]) {
+		case EPOLL_CTL_ADD:
+			if (e) {
+				err = -EEXIST;
+				break;
+			}
+			if (!(e = (struct epitem *) malloc(sizeof(struct epitem)))) {
+				err = -ENOMEM;
+				break;
+			}
+			e->e_ep = ep;
+			e->e_file = filp;
+			e->e_fd = arg[2];
+			e->e_events = events;
+			e->e_data = data;
+			e->e_ready = 0;
+			e->e_watch[0].w_queue = e->e_watch[1].w_queue = NULL;
+			e->e_watch[0].w_item = e->e_watch[1].w_item = e;
+			if (err = arm_item(e)) {
+				free_s(e,sizeof(struct epitem));
+				break;
+			}
+			e->e_next = ep->ep_items;
+			ep->ep_items = e;
+			nr_epitems++;
+			break;
+		case EPOLL_CTL_MOD:
+			if (!e) {
+				err = -ENOENT;
+				break;
+			}
+			e->e_events = events;
+			e->e_data = data;
+			err = arm_item(e);
+			break;
+		case EPOLL_CTL_DEL:
+			if (!e)
+				err = -ENOENT;
+			else
+				remove_item(ep,e);
+			break;
+		default:
+			err = -EINVAL;
+	}
+	unlock_ep(ep);
+	return err;
+}
+
+/*
+ * Takes the items that are on the ready list now off it, and writes out
+ * the events of those that are still ready. Level-triggered ones that
+ * are go back at the end of the list. The ep has to be locked.
+ */
+static int report_ready(struct eventpoll * ep, struct epoll_event * events,
+	int max)
+{
+	struct task_struct ** in, ** out;
+	struct epitem * e, * last;
+	int n = 0, mask;
+
+	cli();
+	last = ep->ep_last;
+	while (n < max && (e = ep->ep_ready)) {
+		if (!(ep->ep_ready = e->e_rdnext))
+			ep->ep_last = NULL;
+		e->e_ready = 0;
+		mask = file_poll(e->e_file,&in,&out);
+		if (mask > 0 && (mask &= e->e_events | EPOLLERR | EPOLLHUP)) {
+			sti();
+			put_fs_long(mask,&events[n].events);
+			put_fs_long(e->e_data,&events[n].data.u32);
+			n++;
+			cli();
+			if (!(e->e_events & EPOLLET) && !e->e_ready)
+				make_ready(e);
+		}
+		if (e == last)
+			break;
+	}
+	sti();
+	return n;
+}
+
+int sys_epoll_wait(unsigned long * buffer)
+{
+	struct eventpoll * ep;
+	struct epoll_event * events;
+	unsigned long arg[4];
+	long timeout;
+	int i, max, n;
+
+	for (i=0 ; i<4 ; i++)
+		arg[i] = get_fs_long(buffer+i);
+	if (!(ep = get_ep(arg[0])))
+		return -EBADF;
+	events = (struct epoll_event *) arg[1];
+	if ((max = arg[2]) <= 0)
+		return -EINVAL;
+	verify_area(events,max*sizeof(struct epoll_event));
+	if ((timeout = arg[3]) > 0)
+		current->timeout = jiffies + MSECS_TO_CT(timeout);
+	for (;;) {
+		lock_ep(ep);
+		n = report_ready(ep,events,max);
+		unlock_ep(ep);
+		if (n || !timeout || (timeout > 0 && !current->timeout))
+			break;
+		if (current->signal & ~current->blocked) {
+			n = -EINTR;
+			break;
+		}
+		cli();
+		if (!ep->ep_ready)
+			interruptible_sleep_on(&ep->ep_wait);
+		sti();
+	}
+	current->timeout = 0;
+	return n;
+}
+
+/*
+ * Called by close() for the last user of a file, before the file is
+ * freed: it goes from all the epoll files it was in, and if it's an epoll
+ * file itself, that goes too. Nobody can add the file to an epoll file
+ * any more while we sleep, so one look at each is enough.
+ */
+void epoll_release(struct file * filp)
+{
+	struct eventpoll * ep, * next;
+	struct epitem * e, * enext;
+
+	for (ep = first_ep ; ep ; ep = ep->ep_next)
+		if (!ep->ep_dead && ep->ep_inode == filp->f_inode) {
+			ep->ep_count++;
+			lock_ep(ep);
+			while (ep->ep_items)
+				remove_item(ep,ep->ep_items);
+			ep->ep_dead = 1;
+			ep->ep_inode = NULL;
+			unlock_ep(ep);
+			put_ep(ep);
+			return;
+		}
+	if (!nr_epitems)
+		return;
+/* ep_next is only read once we're done sleeping, while ep is still held */
+	for (ep = first_ep ; ep ; ep = next) {
+		ep->ep_count++;
+		lock_ep(ep);
+		for (e = ep->ep_items ; e ; e = enext) {
+			enext = e->e_next;
+			if (e->e_file == filp)
+				remove_item(ep,e);
+		}
+		unlock_ep(ep);
+		next = ep->ep_next;
+		put_ep(ep);
+	}
+}
@@ -56,7 +56,7 @@ int sys_uselib(const char * library)
 	current->library = NULL;
 	base = get_base(current->ldt[2]);
 	base += LIBRARY_OFFSET;
-	free_page_tables(base,LIBRARY_SIZE);
+	free_page_tables(current,base,LIBRARY_SIZE);
 	current->library = inode;
 	return 0;
 }
@@ -216,6 +216,7 @@ int do_execve(unsigned long * eip,long tmp,char * filename,
 	int retval;
 	int sh_bang = 0;
 	unsigned long p=PAGE_SIZE*MAX_ARG_PAGES-4;
+	unsigned long dir = 0;
 
 	if ((0xffff & eip[1]) != 0x000f)
 		panic("execve called from supervisor mode");
@@ -340,6 +341,11 @@ restart_interp:
 			goto exec_error2;
 		}
 	}
+/* a vfork() child gives its parent's memory back, and gets its own */
+	if ((current->flags & PF_VFORK) && !(dir = get_page_dir())) {
+		retval = -ENOMEM;
+		goto exec_error2;
+	}
 /* OK, This is the point of no return */
 /* note that current->library stays unchanged by an exec */
 	if (current->executable)
@@ -356,8 +362,15 @@ restart_interp:
 		if ((current->close_on_exec>>i)&1)
 			sys_close(i);
 	current->close_on_exec = 0;
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	if (dir) {
+		current->tss.cr3 = dir;
+		__asm__("movl %%eax,%%cr3"::"a" (dir));
+		end_vfork();
+	} else {
+		exit_mmap();
+		free_page_tables(current,get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(current,get_base(current->ldt[2]),get_limit(0x17));
+	}
 	if (last_task_used_math == current)
 		last_task_used_math = NULL;
 	current->used_math = 0;
@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 
 extern int sys_close(int fd);
+extern int pipe_resize(struct m_inode * inode, unsigned long size);
 
 static int dupfd(unsigned int fd, unsigned int arg)
 {
@@ -67,6 +68,14 @@ int sys_fcntl(unsigned int fd, unsigned int cmd, unsigned long arg)
 			filp->f_flags &= ~(O_APPEND | O_NONBLOCK);
 			filp->f_flags |= arg & (O_APPEND | O_NONBLOCK);
 			return 0;
+		case F_SETPIPE_SZ:
+			if (!filp->f_inode->i_pipe)
+				return -EBADF;
+			return pipe_resize(filp->f_inode,arg);
+		case F_GETPIPE_SZ:
+			if (!filp->f_inode->i_pipe)
+				return -EBADF;
+			return PIPE_LIMIT(*filp->f_inode);
 		case F_GETLK:	case F_SETLK:	case F_SETLKW:
 			return -1;
 		default:
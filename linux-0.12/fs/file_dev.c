@@ -6,6 +6,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include <linux/sched.h>
 #include <linux/kernel.h>
@@ -14,6 +15,11 @@
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
+/*
+ * Regular files are read through the page cache (mm/filemap.c), which
+ * demand-loading uses too. Directories still go through the buffers, as
+ * namei.c changes them there.
+ */
 int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
 	int left,chars,nr;
@@ -21,6 +27,27 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 
 	if ((left=count)<=0)
 		return 0;
+	if (S_ISREG(inode->i_mode)) {
+		unsigned long page;
+		char * p;
+		int error = 0;
+
+		while (left) {
+			if (!(page = read_cached_page(inode,filp->f_pos,&nr))) {
+				error = nr;
+				break;
+			}
+			chars = MIN( PAGE_SIZE-nr , left );
+			filp->f_pos += chars;
+			left -= chars;
+			p = nr + (char *) page;
+			while (chars-->0)
+				put_fs_byte(*(p++),buf++);
+			free_page(page);
+		}
+		inode->i_atime = CURRENT_TIME;
+		return (count-left)?(count-left):error;
+	}
 	while (left) {
 		if (nr = bmap(inode,(filp->f_pos)/BLOCK_SIZE)) {
 			if (!(bh=bread(inode->i_dev,nr)))
@@ -48,7 +75,7 @@ int file_read(struct m_inode * inode, struct file * filp, char * buf, int count)
 int file_write(struct m_inode * inode, struct file * filp, char * buf, int count)
 {
 	off_t pos;
-	int block,c;
+	int block,c,n;
 	struct buffer_head * bh;
 	char * p;
 	int i=0;
@@ -68,7 +95,7 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 			break;
 		c = pos % BLOCK_SIZE;
 		p = c + bh->b_data;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		c = BLOCK_SIZE-c;
 		if (c > count-i) c = count-i;
 		pos += c;
@@ -77,9 +104,12 @@ int file_write(struct m_inode * inode, struct file * filp, char * buf, int count
 			inode->i_dirt = 1;
 		}
 		i += c;
+		n = c;
 		while (c-->0)
 			*(p++) = get_fs_byte(buf++);
+		update_cached_pages(inode,pos-n,p-n,n);
 		brelse(bh);
+		balance_dirty();
 	}
 	inode->i_mtime = CURRENT_TIME;
 	if (!(filp->f_flags & O_APPEND)) {
@@ -103,7 +103,7 @@ static int _bmap(struct m_inode * inode,int block,int create)
 		if (create && !i)
 			if (i=new_block(inode->i_dev)) {
 				((unsigned short *) (bh->b_data))[block]=i;
-				bh->b_dirt=1;
+				mark_buffer_dirty(bh);
 			}
 		brelse(bh);
 		return i;
@@ -122,7 +122,7 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	if (create && !i)
 		if (i=new_block(inode->i_dev)) {
 			((unsigned short *) (bh->b_data))[block>>9]=i;
-			bh->b_dirt=1;
+			mark_buffer_dirty(bh);
 		}
 	brelse(bh);
 	if (!i)
@@ -133,7 +133,7 @@ static int _bmap(struct m_inode * inode,int block,int create)
 	if (create && !i)
 		if (i=new_block(inode->i_dev)) {
 			((unsigned short *) (bh->b_data))[block&511]=i;
-			bh->b_dirt=1;
+			mark_buffer_dirty(bh);
 		}
 	brelse(bh);
 	return i;
@@ -151,6 +151,8 @@ int create_block(struct m_inode * inode, int block)
 		
 void iput(struct m_inode * inode)
 {
+	int i;
+
 	if (!inode)
 		return;
 	wait_on_inode(inode);
@@ -161,6 +163,8 @@ void iput(struct m_inode * inode)
 		wake_up(&inode->i_wait2);
 		if (--inode->i_count)
 			return;
+		for (i=0 ; i<PIPE_INFO(*inode)->p_pages ; i++)
+			free_page(PIPE_INFO(*inode)->p_page[i] & 0xfffff000);
 		free_page(inode->i_size);
 		inode->i_count=0;
 		inode->i_dirt=0;
@@ -239,7 +243,7 @@ struct m_inode * get_pipe_inode(void)
 		return NULL;
 	}
 	inode->i_count = 2;	/* sum of readers/writers */
-	PIPE_HEAD(*inode) = PIPE_TAIL(*inode) = 0;
+	PIPE_INFO(*inode)->p_pages = PIPE_DEF_PAGES;
 	inode->i_pipe = 1;
 	return inode;
 }
@@ -341,7 +345,7 @@ static void write_inode(struct m_inode * inode)
 	((struct d_inode *)bh->b_data)
 		[(inode->i_num-1)%INODES_PER_BLOCK] =
 			*(struct d_inode *)inode;
-	bh->b_dirt=1;
+	mark_buffer_dirty(bh);
 	inode->i_dirt=0;
 	brelse(bh);
 	unlock_inode(inode);
@@ -212,7 +212,7 @@ static struct buffer_head * add_entry(struct m_inode * dir,
 			dir->i_mtime = CURRENT_TIME;
 			for (i=0; i < NAME_LEN ; i++)
 				de->name[i]=(i<namelen)?get_fs_byte(name+i):0;
-			bh->b_dirt = 1;
+			mark_buffer_dirty(bh);
 			*res_dir = de;
 			return bh;
 		}
@@ -434,7 +434,7 @@ int open_namei(const char * pathname, int flag, int mode,
 			return -ENOSPC;
 		}
 		de->inode = inode->i_num;
-		bh->b_dirt = 1;
+		mark_buffer_dirty(bh);
 		brelse(bh);
 		iput(dir);
 		*res_inode = inode;
@@ -505,7 +505,7 @@ int sys_mknod(const char * filename, int mode, int dev)
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	iput(dir);
 	iput(inode);
 	brelse(bh);
@@ -564,7 +564,7 @@ int sys_mkdir(const char * pathname, int mode)
 	de->inode = dir->i_num;
 	strcpy(de->name,"..");
 	inode->i_nlinks = 2;
-	dir_block->b_dirt = 1;
+	mark_buffer_dirty(dir_block);
 	brelse(dir_block);
 	inode->i_mode = I_DIRECTORY | (mode & 0777 & ~current->umask);
 	inode->i_dirt = 1;
@@ -576,7 +576,7 @@ int sys_mkdir(const char * pathname, int mode)
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	dir->i_nlinks++;
 	dir->i_dirt = 1;
 	iput(dir);
@@ -694,7 +694,7 @@ int sys_rmdir(const char * name)
 	if (inode->i_nlinks != 2)
 		printk("empty directory has nlink!=2 (%d)",inode->i_nlinks);
 	de->inode = 0;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	inode->i_nlinks=0;
 	inode->i_dirt=1;
@@ -754,7 +754,7 @@ int sys_unlink(const char * name)
 		inode->i_nlinks=1;
 	}
 	de->inode = 0;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	inode->i_nlinks--;
 	inode->i_dirt = 1;
@@ -807,7 +807,7 @@ int sys_symlink(const char * oldname, const char * newname)
 	while (i < 1023 && (c=get_fs_byte(oldname++)))
 		name_block->b_data[i++] = c;
 	name_block->b_data[i] = 0;
-	name_block->b_dirt = 1;
+	mark_buffer_dirty(name_block);
 	brelse(name_block);
 	inode->i_size = i;
 	inode->i_dirt = 1;
@@ -827,7 +827,7 @@ int sys_symlink(const char * oldname, const char * newname)
 		return -ENOSPC;
 	}
 	de->inode = inode->i_num;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	iput(dir);
 	iput(inode);
@@ -883,7 +883,7 @@ int sys_link(const char * oldname, const char * newname)
 		return -ENOSPC;
 	}
 	de->inode = oldinode->i_num;
-	bh->b_dirt = 1;
+	mark_buffer_dirty(bh);
 	brelse(bh);
 	iput(dir);
 	oldinode->i_nlinks++;
@@ -219,6 +219,7 @@ int sys_creat(const char * pathname, int mode)
 int sys_close(unsigned int fd)
 {	
 	struct file * filp;
+	struct m_inode * inode;
 
 	if (fd >= NR_OPEN)
 		return -EINVAL;
@@ -228,8 +229,14 @@ int sys_close(unsigned int fd)
 	current->filp[fd] = NULL;
 	if (filp->f_count == 0)
 		panic("Close: file count is 0");
-	if (--filp->f_count)
+	if (filp->f_count > 1) {
+		filp->f_count--;
 		return (0);
-	iput(filp->f_inode);
+	}
+/* epoll_release() may sleep: the file is only free once it's done */
+	inode = filp->f_inode;
+	epoll_release(filp);
+	filp->f_count = 0;
+	iput(inode);
 	return (0);
 }
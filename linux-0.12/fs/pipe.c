@@ -6,73 +6,573 @@
 
 #include <signal.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <termios.h>
+#include <sys/stat.h>
 
 #include <linux/sched.h>
 #include <linux/mm.h>	/* for get_free_page */
 #include <asm/segment.h>
 #include <linux/kernel.h>
+#include <asm/system.h>
+
+extern int file_write(struct m_inode * inode, struct file * filp,
+		char * buf, int count);
+
+/*
+ * The pipe is a ring of pages, filled lazily: a pipe that never has much
+ * in it never gets more than its first page, as an empty pipe starts
+ * over at the beginning. Readers and writers copy a page at a time, with
+ * the pipe locked: the copy may fault, and sleep. Only the bytes already
+ * copied are counted in p_size, so nobody sees what isn't there yet.
+ * Sleepers are only woken when it matters: readers when the pipe stops
+ * being empty, writers when it stops being full.
+ *
+ * splice() and tee() can put a whole page into the ring without copying
+ * it: a page of the page cache, or a page of another pipe. Such a page is
+ * PIPE_BORROWED. It's full of data, nobody writes to it, and it's let go
+ * as soon as it has been read: a writer that finds one where it wants to
+ * write waits for that, as if the pipe were full (pipe_room() in fs.h).
+ */
+#define pipe_page(p,pos) ((p)->p_page[(pos)>>12] & 0xfffff000)
+
+static inline void lock_pipe(struct pipe_buf * p)
+{
+	cli();
+	while (p->p_lock)
+		sleep_on(&p->p_wait);
+	p->p_lock = 1;
+	sti();
+}
+
+static inline void unlock_pipe(struct pipe_buf * p)
+{
+	p->p_lock = 0;
+	wake_up(&p->p_wait);
+}
+
+/*
+ * Takes 'chars' bytes off the tail, which never crosses the end of a page.
+ * Returns 1 if the writers should be woken.
+ */
+static int consume(struct m_inode * inode, int chars)
+{
+	struct pipe_buf * p = PIPE_INFO(*inode);
+	int wake = PIPE_FULL(*inode), nr = p->p_tail>>12;
+
+	if ((p->p_tail += chars) >= PIPE_LIMIT(*inode))
+		p->p_tail = 0;
+	if (!(p->p_tail & (PAGE_SIZE-1)) && (p->p_page[nr] & PIPE_BORROWED)) {
+		free_page(p->p_page[nr] & 0xfffff000);
+		p->p_page[nr] = 0;
+		wake = 1;
+	}
+	if (!(p->p_size -= chars))
+		p->p_head = p->p_tail = 0;
+	return wake;
+}
+
+/* adds 'chars' bytes at the head: returns 1 if the readers should be woken */
+static int produce(struct m_inode * inode, int chars)
+{
+	struct pipe_buf * p = PIPE_INFO(*inode);
+	int wake = PIPE_EMPTY(*inode);
+
+	if ((p->p_head += chars) >= PIPE_LIMIT(*inode))
+		p->p_head = 0;
+	p->p_size += chars;
+	return wake;
+}
+
+/*
+ * Makes sure there is a page to write to at the head. Returns 0 if there
+ * is, 1 if we had to get one (and may have slept), -ENOMEM if we couldn't.
+ */
+static int head_page(struct pipe_buf * p)
+{
+	unsigned long page;
+
+	if (p->p_page[p->p_head>>12])
+		return 0;
+	if (!(page = get_free_page()))
+		return -ENOMEM;
+/* we may have slept: somebody else may have put a page there */
+	if (p->p_page[p->p_head>>12])
+		free_page(page);
+	else
+		p->p_page[p->p_head>>12] = page;
+	return 1;
+}
+
+/*
+ * Puts a whole page into the ring, without copying it, if there's a
+ * free page at the head: the pipe gets the caller's reference. Returns 0
+ * if it didn't fit, or if the page has too many users to be lent out
+ * once more. Doesn't sleep.
+ */
+static int give_page(struct m_inode * inode, unsigned long page)
+{
+	struct pipe_buf * p = PIPE_INFO(*inode);
+	unsigned long old;
+
+	if ((p->p_head & (PAGE_SIZE-1)) || p->p_lock ||
+	    PIPE_LIMIT(*inode) - p->p_size < PAGE_SIZE ||
+	    mem_map[MAP_NR(page)] > PAGE_MAX_SHARE)
+		return 0;
+	old = p->p_page[p->p_head>>12];
+	p->p_page[p->p_head>>12] = page | PIPE_BORROWED;
+	free_page(old);
+	if (produce(inode,PAGE_SIZE))
+		wake_up(& PIPE_READ_WAIT(*inode));
+	return 1;
+}
+
+/*
+ * Waits for something to read. Returns 0 if there is, 1 if there never
+ * will be (no writers), -ERESTARTSYS if a signal came first.
+ */
+static int wait_for_data(struct m_inode * inode)
+{
+	while (PIPE_EMPTY(*inode)) {
+		if (inode->i_count != 2) /* are there any writers? */
+			return 1;
+		if (current->signal & ~current->blocked)
+			return -ERESTARTSYS;
+		interruptible_sleep_on(& PIPE_READ_WAIT(*inode));
+	}
+	return 0;
+}
+
+/* waits for room to write: returns -1 (and SIGPIPE) if there are no readers */
+static int wait_for_room(struct m_inode * inode)
+{
+	while (!pipe_room(*inode)) {
+		if (inode->i_count != 2) { /* no readers */
+			current->signal |= (1<<(SIGPIPE-1));
+			return -1;
+		}
+		sleep_on(& PIPE_WRITE_WAIT(*inode));
+	}
+	return 0;
+}
 
 int read_pipe(struct m_inode * inode, char * buf, int count)
 {
-	int chars, size, read = 0;
+	struct pipe_buf * p = PIPE_INFO(*inode);
+	int chars, offset, wake, read = 0;
 
 	while (count>0) {
-		while (!(size=PIPE_SIZE(*inode))) {
-			wake_up(& PIPE_WRITE_WAIT(*inode));
-			if (inode->i_count != 2) /* are there any writers? */
-				return read;
-			if (current->signal & ~current->blocked)
-				return read?read:-ERESTARTSYS;
-			interruptible_sleep_on(& PIPE_READ_WAIT(*inode));
+		if (chars = wait_for_data(inode))
+			return (read || chars > 0) ? read : chars;
+		lock_pipe(p);
+		if (PIPE_EMPTY(*inode)) {
+			unlock_pipe(p);
+			continue;
 		}
-		chars = PAGE_SIZE-PIPE_TAIL(*inode);
+		offset = p->p_tail & (PAGE_SIZE-1);
+		chars = PAGE_SIZE-offset;
 		if (chars > count)
 			chars = count;
-		if (chars > size)
-			chars = size;
+		if (chars > p->p_size)
+			chars = p->p_size;
+		memcpy_tofs(buf,(char *) pipe_page(p,p->p_tail) + offset,chars);
+		wake = consume(inode,chars);
+		unlock_pipe(p);
+		if (wake)
+			wake_up(& PIPE_WRITE_WAIT(*inode));
 		count -= chars;
 		read += chars;
-		size = PIPE_TAIL(*inode);
-		PIPE_TAIL(*inode) += chars;
-		PIPE_TAIL(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			put_fs_byte(((char *)inode->i_size)[size++],buf++);
+		buf += chars;
 	}
-	wake_up(& PIPE_WRITE_WAIT(*inode));
 	return read;
 }
 	
 int write_pipe(struct m_inode * inode, char * buf, int count)
 {
-	int chars, size, written = 0;
+	struct pipe_buf * p = PIPE_INFO(*inode);
+	int chars, offset, wake, written = 0;
 
 	while (count>0) {
-		while (!(size=(PAGE_SIZE-1)-PIPE_SIZE(*inode))) {
-			wake_up(& PIPE_READ_WAIT(*inode));
-			if (inode->i_count != 2) { /* no readers */
-				current->signal |= (1<<(SIGPIPE-1));
-				return written?written:-1;
-			}
-			sleep_on(& PIPE_WRITE_WAIT(*inode));
+		if (wait_for_room(inode))
+			return written?written:-1;
+		if (chars = head_page(p)) {
+			if (chars < 0)
+				return written?written:chars;
+			continue;
+		}
+		lock_pipe(p);
+		if (!pipe_room(*inode) || !p->p_page[p->p_head>>12]) {
+			unlock_pipe(p);
+			continue;
 		}
-		chars = PAGE_SIZE-PIPE_HEAD(*inode);
+		offset = p->p_head & (PAGE_SIZE-1);
+		chars = PAGE_SIZE-offset;
 		if (chars > count)
 			chars = count;
-		if (chars > size)
-			chars = size;
+		if (chars > PIPE_LIMIT(*inode) - p->p_size)
+			chars = PIPE_LIMIT(*inode) - p->p_size;
+		memcpy_fromfs((char *) pipe_page(p,p->p_head) + offset,buf,chars);
+		wake = produce(inode,chars);
+		unlock_pipe(p);
+		if (wake)
+			wake_up(& PIPE_READ_WAIT(*inode));
 		count -= chars;
 		written += chars;
-		size = PIPE_HEAD(*inode);
-		PIPE_HEAD(*inode) += chars;
-		PIPE_HEAD(*inode) &= (PAGE_SIZE-1);
-		while (chars-->0)
-			((char *)inode->i_size)[size++]=get_fs_byte(buf++);
+		buf += chars;
 	}
-	wake_up(& PIPE_READ_WAIT(*inode));
 	return written;
 }
 
+/* turns the first 'n' pages of the ring round, so that a[k] comes first */
+static void turn(unsigned long * a, int n, int k)
+{
+	unsigned long tmp;
+	int i, j;
+
+	for (i = 0, j = k-1 ; i < j ; i++, j--)
+		tmp = a[i], a[i] = a[j], a[j] = tmp;
+	for (i = k, j = n-1 ; i < j ; i++, j--)
+		tmp = a[i], a[i] = a[j], a[j] = tmp;
+	for (i = 0, j = n-1 ; i < j ; i++, j--)
+		tmp = a[i], a[i] = a[j], a[j] = tmp;
+}
+
+/*
+ * fcntl(F_SETPIPE_SZ): the pages are turned round so that the data starts
+ * in the first one, and the pages past the new end are freed. The data
+ * has to fit without going round the ring, which it always does if the
+ * pipe isn't nearly full. Only the super-user may make a pipe bigger
+ * than PIPE_DEF_PAGES: the pages are kernel memory that can't be paged.
+ * Returns the new size.
+ */
+int pipe_resize(struct m_inode * inode, unsigned long size)
+{
+	struct pipe_buf * p = PIPE_INFO(*inode);
+	int pages, i;
+
+	if (size > PIPE_MAX_PAGES*PAGE_SIZE)
+		return -EINVAL;
+	if (!(pages = (size + PAGE_SIZE-1) >> 12))
+		pages = 1;
+	if (pages > PIPE_DEF_PAGES && pages > p->p_pages && !suser())
+		return -EPERM;
+	lock_pipe(p);
+	if ((p->p_tail & (PAGE_SIZE-1)) + p->p_size >
+	    ((pages < p->p_pages) ? pages : p->p_pages) * PAGE_SIZE) {
+		unlock_pipe(p);
+		return -EBUSY;
+	}
+	turn(p->p_page,p->p_pages,p->p_tail>>12);
+	p->p_tail &= PAGE_SIZE-1;
+	for (i = pages ; i < p->p_pages ; i++) {
+		free_page(p->p_page[i] & 0xfffff000);
+		p->p_page[i] = 0;
+	}
+	p->p_pages = pages;
+	if ((p->p_head = p->p_tail + p->p_size) >= PIPE_LIMIT(*inode))
+		p->p_head = 0;
+	unlock_pipe(p);
+	wake_up(& PIPE_WRITE_WAIT(*inode));
+	return pages*PAGE_SIZE;
+}
+
+/*
+ * A file to a pipe: the pages come from the page cache, read ahead as
+ * for demand-loading. A whole page of the file is given to the pipe as
+ * it is, the rest is copied by
+ * write_pipe(), straight from the cached page. Like anything mapped from
+ * the page cache, a page in the pipe shows what is written to the file
+ * later on.
+ */
+int file_to_pipe(struct file * filp, struct m_inode * pipe, int len)
+{
+	struct m_inode * inode = filp->f_inode;
+	unsigned long page, old_fs;
+	int nr, chars, n, done = 0;
+
+	while (len > 0 && filp->f_pos < inode->i_size) {
+		page_read_ahead(inode,filp->f_pos & 0xfffff000);
+		if (!(page = read_cached_page(inode,filp->f_pos,&nr))) {
+			if (!done)
+				done = nr;
+			break;
+		}
+		chars = PAGE_SIZE-nr;
+		if (chars > len)
+			chars = len;
+		if (chars > inode->i_size - filp->f_pos)
+			chars = inode->i_size - filp->f_pos;
+		if (chars == PAGE_SIZE && pipe->i_count == 2 &&
+		    give_page(pipe,page))
+			n = PAGE_SIZE;
+		else {
+			old_fs = get_fs();
+			set_fs(get_ds());
+			n = write_pipe(pipe,nr + (char *) page,chars);
+			set_fs(old_fs);
+			free_page(page);
+		}
+		if (n <= 0)
+			return done?done:n;
+		filp->f_pos += n;
+		done += n;
+		len -= n;
+		if (n < chars)
+			break;
+	}
+	inode->i_atime = CURRENT_TIME;
+	return done;
+}
+
+/*
+ * A pipe to a file: what's in the pipe (we only wait for the first byte)
+ * goes to file_write() a page at a time. file_write() does disk I/O, so
+ * it isn't done with the pipe locked: each chunk is taken out of the pipe
+ * first, copied to a page of our own, or just held on to if it's a
+ * borrowed page, which nobody writes to, and which hasn't too many users
+ * already. A chunk that can't be written is lost, as after a read() and
+ * a write() that fails.
+ */
+static int pipe_to_file(struct m_inode * pipe, struct file * filp, int len)
+{
+	struct pipe_buf * p = PIPE_INFO(*pipe);
+	unsigned long old_fs, buf, page;
+	char * from;
+	int chars, offset, n, wake, done = 0;
+
+	if (!(buf = get_free_page()))
+		return -ENOMEM;
+	while (len > 0) {
+		if (done && PIPE_EMPTY(*pipe))
+			break;
+		if (n = wait_for_data(pipe)) {
+			if (!done && n < 0)
+				done = n;
+			break;
+		}
+		lock_pipe(p);
+		if (PIPE_EMPTY(*pipe)) {
+			unlock_pipe(p);
+			continue;
+		}
+		offset = p->p_tail & (PAGE_SIZE-1);
+		chars = PAGE_SIZE-offset;
+		if (chars > len)
+			chars = len;
+		if (chars > p->p_size)
+			chars = p->p_size;
+		page = pipe_page(p,p->p_tail);
+		if ((p->p_page[p->p_tail>>12] & PIPE_BORROWED) &&
+		    mem_map[MAP_NR(page)] < PAGE_MAX_SHARE) {
+			mem_map[MAP_NR(page)]++;
+			from = offset + (char *) page;
+		} else {
+			memcpy((char *) buf,offset + (char *) page,chars);
+			from = (char *) buf;
+			page = 0;
+		}
+		wake = consume(pipe,chars);
+		unlock_pipe(p);
+		if (wake)
+			wake_up(& PIPE_WRITE_WAIT(*pipe));
+		old_fs = get_fs();
+		set_fs(get_ds());
+		n = file_write(filp->f_inode,filp,from,chars);
+		set_fs(old_fs);
+		if (page)
+			free_page(page);
+		if (n <= 0) {
+			if (!done)
+				done = -EIO;
+			break;
+		}
+		done += n;
+		len -= n;
+		if (n < chars)
+			break;
+	}
+	free_page(buf);
+	return done;
+}
+
+/*
+ * A pipe to a pipe: splice() moves the data, tee() copies it and leaves it
+ * where it was. Whole pages go over without being copied: splice() hands
+ * the page itself over, tee() lends it to both, unless it has
+ * PAGE_MAX_SHARE users already. We only wait for data and room for the
+ * first chunk, and both pipes are locked in the same order always, so
+ * that two tasks going opposite ways can't block each other.
+ */
+static int pipe_to_pipe(struct m_inode * from, struct m_inode * to, int len,
+	int move)
+{
+	struct pipe_buf * f = PIPE_INFO(*from), * t = PIPE_INFO(*to);
+	struct pipe_buf * first, * second;
+	unsigned long pos, page;
+	int chars, n, wake_from, wake_to, done = 0;
+
+	if (f < t)
+		first = f, second = t;
+	else
+		first = t, second = f;
+	while (len > 0) {
+		if (!done) {
+			if (n = wait_for_data(from))
+				return (n > 0) ? 0 : n;
+			if (wait_for_room(to))
+				return -1;
+		}
+		if (n = head_page(t)) {
+			if (n < 0 || done)
+				return done?done:n;
+			continue;
+		}
+		lock_pipe(first);
+		lock_pipe(second);
+		pos = f->p_tail + (move ? 0 : done);
+		if (pos >= PIPE_LIMIT(*from))
+			pos -= PIPE_LIMIT(*from);
+		chars = f->p_size - (move ? 0 : done);
+		if (chars <= 0 || !pipe_room(*to) || !t->p_page[t->p_head>>12]) {
+			unlock_pipe(second);
+			unlock_pipe(first);
+			if (done)
+				break;
+			continue;
+		}
+		if (chars > len)
+			chars = len;
+		if (chars > PAGE_SIZE - (pos & (PAGE_SIZE-1)))
+			chars = PAGE_SIZE - (pos & (PAGE_SIZE-1));
+		if (chars == PAGE_SIZE && !(t->p_head & (PAGE_SIZE-1)) &&
+		    PIPE_LIMIT(*to) - t->p_size >= PAGE_SIZE && (move ||
+		    mem_map[MAP_NR(f->p_page[pos>>12] & 0xfffff000)] < PAGE_MAX_SHARE)) {
+			page = f->p_page[pos>>12];
+			if (move)
+				f->p_page[pos>>12] = 0;
+			else {
+				f->p_page[pos>>12] = page |= PIPE_BORROWED;
+				mem_map[MAP_NR(page & 0xfffff000)]++;
+			}
+			free_page(t->p_page[t->p_head>>12]);
+			t->p_page[t->p_head>>12] = page;
+		} else {
+			if (chars > PAGE_SIZE - (t->p_head & (PAGE_SIZE-1)))
+				chars = PAGE_SIZE - (t->p_head & (PAGE_SIZE-1));
+			if (chars > PIPE_LIMIT(*to) - t->p_size)
+				chars = PIPE_LIMIT(*to) - t->p_size;
+			memcpy((char *) pipe_page(t,t->p_head) +
+				(t->p_head & (PAGE_SIZE-1)),
+				(char *) pipe_page(f,pos) + (pos & (PAGE_SIZE-1)),
+				chars);
+		}
+		wake_to = produce(to,chars);
+		wake_from = move ? consume(from,chars) : 0;
+		unlock_pipe(second);
+		unlock_pipe(first);
+		if (wake_to)
+			wake_up(& PIPE_READ_WAIT(*to));
+		if (wake_from)
+			wake_up(& PIPE_WRITE_WAIT(*from));
+		done += chars;
+		len -= chars;
+	}
+	return done;
+}
+
+static int splice_files(unsigned int fd_in, unsigned int fd_out, int len,
+	struct file ** in, struct file ** out)
+{
+	if (fd_in >= NR_OPEN || !(*in = current->filp[fd_in]) ||
+	    fd_out >= NR_OPEN || !(*out = current->filp[fd_out]))
+		return -EBADF;
+	if (!((*in)->f_mode & 1) || !((*out)->f_mode & 2))
+		return -EBADF;
+	if (len < 0 || (*in)->f_inode == (*out)->f_inode)
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * splice(fd_in, off_in, fd_out, off_out, len, flags) moves up to 'len'
+ * bytes from one file to another without going through user space. One
+ * of them has to be a pipe, the other a pipe or a regular file. If the
+ * offset of the file isn't NULL, the file is read or written from there,
+ * the offset is updated and the file position left alone, as in
+ * sendfile(). A pipe has no offset. With SPLICE_F_NONBLOCK we don't wait
+ * for the pipes to begin with. Returns what was moved, 0 at the end of
+ * the file or of the pipe. The six arguments are in a block in user
+ * space, like those of mmap().
+ */
+int sys_splice(unsigned long * buffer)
+{
+	struct file * in, * out, * filp, tmp;
+	unsigned long arg[6];
+	off_t * offset;
+	int i, len, flags, error, done;
+
+	for (i=0 ; i<6 ; i++)
+		arg[i] = get_fs_long(buffer+i);
+	len = arg[4];
+	flags = arg[5];
+	if (error = splice_files(arg[0],arg[2],len,&in,&out))
+		return error;
+	if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE))
+		return -EINVAL;
+	if ((arg[1] && in->f_inode->i_pipe) || (arg[3] && out->f_inode->i_pipe))
+		return -ESPIPE;
+	if (in->f_inode->i_pipe && (out->f_inode->i_pipe ||
+	    S_ISREG(out->f_inode->i_mode)))
+		filp = out, offset = (off_t *) arg[3];
+	else if (out->f_inode->i_pipe && S_ISREG(in->f_inode->i_mode))
+		filp = in, offset = (off_t *) arg[1];
+	else
+		return -EINVAL;
+	if (!len)
+		return 0;
+	if (flags & SPLICE_F_NONBLOCK) {
+		if (in->f_inode->i_pipe && PIPE_EMPTY(*in->f_inode) &&
+		    in->f_inode->i_count == 2)
+			return -EAGAIN;
+		if (out->f_inode->i_pipe && !pipe_room(*out->f_inode) &&
+		    out->f_inode->i_count == 2)
+			return -EAGAIN;
+	}
+	if (in->f_inode->i_pipe && out->f_inode->i_pipe)
+		return pipe_to_pipe(in->f_inode,out->f_inode,len,1);
+	tmp = *filp;
+	if (offset) {
+		verify_area(offset,sizeof(off_t));
+		if ((tmp.f_pos = get_fs_long((unsigned long *) offset)) < 0)
+			return -EINVAL;
+	}
+	if (in->f_inode->i_pipe)
+		done = pipe_to_file(in->f_inode,&tmp,len);
+	else
+		done = file_to_pipe(&tmp,out->f_inode,len);
+	if (offset)
+		put_fs_long(tmp.f_pos,(unsigned long *) offset);
+	else
+		filp->f_pos = tmp.f_pos;
+	return done;
+}
+
+/* tee() copies up to 'len' bytes from one pipe to another, and keeps them */
+int sys_tee(unsigned int fd_in, unsigned int fd_out, int len)
+{
+	struct file * in, * out;
+	int error;
+
+	if (error = splice_files(fd_in,fd_out,len,&in,&out))
+		return error;
+	if (!in->f_inode->i_pipe || !out->f_inode->i_pipe)
+		return -EINVAL;
+	if (!len)
+		return 0;
+	return pipe_to_pipe(in->f_inode,out->f_inode,len,0);
+}
+
 int sys_pipe(unsigned long * fildes)
 {
 	struct m_inode * inode;
@@ -10,6 +10,7 @@
 
 #include <linux/kernel.h>
 #include <linux/sched.h>
+#include <linux/mm.h>
 #include <asm/segment.h>
 
 extern int rw_char(int rw,int dev, char * buf, int count, off_t * pos);
@@ -21,6 +22,7 @@ extern int file_read(struct m_inode * inode, struct file * filp,
 		char * buf, int count);
 extern int file_write(struct m_inode * inode, struct file * filp,
 		char * buf, int count);
+extern int file_to_pipe(struct file * filp, struct m_inode * pipe, int len);
 
 int sys_lseek(unsigned int fd,off_t offset, int origin)
 {
@@ -80,16 +82,11 @@ int sys_read(unsigned int fd,char * buf,int count)
 	return -EINVAL;
 }
 
-int sys_write(unsigned int fd,char * buf,int count)
+/* the write routine of any kind of file, with 'buf' in fs */
+static int write_file(struct file * file, char * buf, int count)
 {
-	struct file * file;
-	struct m_inode * inode;
-	
-	if (fd>=NR_OPEN || count <0 || !(file=current->filp[fd]))
-		return -EINVAL;
-	if (!count)
-		return 0;
-	inode=file->f_inode;
+	struct m_inode * inode = file->f_inode;
+
 	if (inode->i_pipe)
 		return (file->f_mode&2)?write_pipe(inode,buf,count):-EIO;
 	if (S_ISCHR(inode->i_mode))
@@ -101,3 +98,99 @@ int sys_write(unsigned int fd,char * buf,int count)
 	printk("(Write)inode->i_mode=%06o\n\r",inode->i_mode);
 	return -EINVAL;
 }
+
+int sys_write(unsigned int fd,char * buf,int count)
+{
+	struct file * file;
+	
+	if (fd>=NR_OPEN || count <0 || !(file=current->filp[fd]))
+		return -EINVAL;
+	if (!count)
+		return 0;
+	return write_file(file,buf,count);
+}
+
+/*
+ * The pages of a regular file go from the page cache straight to the
+ * write routine of the other file, with fs pointing to the kernel.
+ */
+static int copy_file(struct file * in, struct file * out, int count)
+{
+	struct m_inode * inode = in->f_inode;
+	unsigned long page, old_fs;
+	int nr, chars, n, done = 0;
+
+	while (count > 0 && in->f_pos < inode->i_size) {
+		page_read_ahead(inode,in->f_pos & 0xfffff000);
+		if (!(page = read_cached_page(inode,in->f_pos,&nr))) {
+			if (!done)
+				done = nr;
+			break;
+		}
+		chars = PAGE_SIZE-nr;
+		if (chars > count)
+			chars = count;
+		if (chars > inode->i_size - in->f_pos)
+			chars = inode->i_size - in->f_pos;
+		old_fs = get_fs();
+		set_fs(get_ds());
+		n = write_file(out,nr + (char *) page,chars);
+		set_fs(old_fs);
+		free_page(page);
+		if (n <= 0)
+			return done?done:n;
+		in->f_pos += n;
+		done += n;
+		count -= n;
+		if (n < chars)
+			break;
+	}
+	inode->i_atime = CURRENT_TIME;
+	return done;
+}
+
+/*
+ * sendfile(out_fd, in_fd, offset, count) copies a regular file to any
+ * file that can be written: no copy to user space and back, and no
+ * system call for each block. A pipe even gets whole pages without any
+ * copying, see file_to_pipe(). If 'offset' isn't NULL, the file is read
+ * from there, '*offset' is updated and the file position left alone.
+ * The four arguments are in a block in user space, like those of mmap().
+ */
+int sys_sendfile(unsigned long * buffer)
+{
+	struct file * in, * out, tmp;
+	unsigned long arg[4];
+	off_t * offset;
+	int i, count, done;
+
+	for (i=0 ; i<4 ; i++)
+		arg[i] = get_fs_long(buffer+i);
+	if (arg[0] >= NR_OPEN || !(out = current->filp[arg[0]]) ||
+	    !(out->f_mode & 2))
+		return -EBADF;
+	if (arg[1] >= NR_OPEN || !(in = current->filp[arg[1]]) ||
+	    !(in->f_mode & 1))
+		return -EBADF;
+	offset = (off_t *) arg[2];
+	if ((count = arg[3]) < 0 || in->f_inode->i_pipe ||
+	    !S_ISREG(in->f_inode->i_mode))
+		return -EINVAL;
+	tmp = *in;
+	if (offset) {
+		verify_area(offset,sizeof(off_t));
+		if ((tmp.f_pos = get_fs_long((unsigned long *) offset)) < 0)
+			return -EINVAL;
+	}
+	if (!count)
+		return 0;
+	if (out->f_inode->i_pipe)
+		done = file_to_pipe(&tmp,out->f_inode,count);
+	else
+		done = copy_file(&tmp,out,count);
+	if (offset)
+		put_fs_long(tmp.f_pos,(unsigned long *) offset);
+	else
+		in->f_pos = tmp.f_pos;
+	return done;
+}
@@ -19,6 +19,8 @@
 #include <const.h>
 #include <errno.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/poll.h>
 #include <signal.h>
 
 /*
@@ -48,7 +50,7 @@ static void add_wait(struct task_struct ** wait_address, select_table * p)
 {
 	int i;
 
-	if (!wait_address)
+	if (!wait_address || !p)
 		return;
 	for (i = 0 ; i < p->nr ; i++)
 		if (p->entry[i].wait_address == wait_address)
@@ -96,6 +98,49 @@ static struct tty_struct * get_tty(struct m_inode * inode)
 	return TTY_TABLE(minor);
 }
 
+/*
+ * file_poll() says what a file is ready for, in EPOLLXX bits, and gives
+ * the wait queues that a change shows up on: 'in' for reading and 'out'
+ * for writing, or NULL. Only pipes and ttys can be waited for, anything
+ * else returns -1. A pipe only reports on the direction the file was
+ * opened for.
+ */
+int file_poll(struct file * filp,
+	struct task_struct *** in, struct task_struct *** out)
+{
+	struct m_inode * inode = filp->f_inode;
+	struct tty_struct * tty;
+	int mask = 0;
+
+	*in = *out = NULL;
+	if (tty = get_tty(inode)) {
+		if (!EMPTY(tty->secondary))
+			mask |= EPOLLIN;
+		if (!FULL(tty->write_q))
+			mask |= EPOLLOUT;
+		*in = &tty->secondary->proc_list;
+		*out = &tty->write_q->proc_list;
+		return mask;
+	}
+	if (!inode->i_pipe)
+		return -1;
+	if (filp->f_mode & 1) {
+		if (!PIPE_EMPTY(*inode))
+			mask |= EPOLLIN;
+		if (inode->i_count < 2)
+			mask |= EPOLLHUP;
+		*in = &PIPE_READ_WAIT(*inode);
+	}
+	if (filp->f_mode & 2) {
+		if (pipe_room(*inode))
+			mask |= EPOLLOUT;
+		if (inode->i_count < 2)
+			mask |= EPOLLERR;
+		*out = &PIPE_WRITE_WAIT(*inode);
+	}
+	return mask;
+}
+
 /*
  * The check_XX functions check out a file. We know it's either
  * a pipe, a character device or a fifo (fifo's not implemented)
@@ -127,10 +172,10 @@ static int check_out(select_table * wait, struct m_inode * inode)
 		else
 			add_wait(&tty->write_q->proc_list, wait);
 	else if (inode->i_pipe)
-		if (!PIPE_FULL(*inode))
+		if (pipe_room(*inode))
 			return 1;
 		else
-			add_wait(&inode->i_wait, wait);
+			add_wait(&PIPE_WRITE_WAIT(*inode), wait);
 	return 0;
 }
 
@@ -276,3 +321,92 @@ int sys_select( unsigned long *buffer )
 		return -EINTR;
 	return i;
 }
+
+/*
+ * do_poll() is do_select() for an array of (fd, events): the same
+ * check_XX functions, with interrupts disabled by the caller too. The
+ * first look at the files is made without a wait table: if any of them
+ * is ready, we return without having gone on a single wait queue.
+ * Anything that isn't a pipe or a tty is always ready.
+ */
+static int do_poll(struct pollfd * fds, int nfds, long timeout)
+{
+	select_table wait_table, * wait = NULL;
+	struct pollfd * p;
+	struct file * filp;
+	struct m_inode * inode;
+	int i, count;
+
+repeat:
+	count = 0;
+	for (i = 0, p = fds ; i < nfds ; i++, p++) {
+		p->revents = 0;
+		if (p->fd < 0)
+			continue;
+		if (p->fd >= NR_OPEN || !(filp = current->filp[p->fd]) ||
+		    !(inode = filp->f_inode)) {
+			p->revents = POLLNVAL;
+			count++;
+			continue;
+		}
+		if (!inode->i_pipe && !get_tty(inode))
+			p->revents = p->events & (POLLIN | POLLOUT);
+		else {
+			if ((p->events & POLLIN) && (filp->f_mode & 1) &&
+			    check_in(wait,inode))
+				p->revents |= POLLIN;
+			if ((p->events & POLLOUT) && (filp->f_mode & 2) &&
+			    check_out(wait,inode))
+				p->revents |= POLLOUT;
+			if (check_ex(wait,inode))
+				p->revents |= (filp->f_mode & 1) ? POLLHUP : POLLERR;
+		}
+		if (p->revents)
+			count++;
+	}
+	if (count || !timeout || (timeout > 0 && !current->timeout) ||
+	    (current->signal & ~current->blocked)) {
+		if (wait)
+			free_wait(wait);
+		return count;
+	}
+	if (wait) {
+		current->state = TASK_INTERRUPTIBLE;
+		schedule();
+		free_wait(wait);
+	} else {
+		wait = &wait_table;
+		wait_table.nr = 0;
+	}
+	goto repeat;
+}
+
+/*
+ * poll(fds, nfds, timeout): the timeout is in milliseconds, negative to
+ * wait for ever. The same fd may be in the array more than once, but the
+ * array can't be longer than the fds a task can have.
+ */
+int sys_poll(struct pollfd * fds, unsigned int nfds, long timeout)
+{
+	struct pollfd kfds[NR_OPEN];
+	int i, count;
+
+	if (nfds > NR_OPEN)
+		return -EINVAL;
+	verify_area(fds, nfds*sizeof(struct pollfd));
+	for (i = 0 ; i < nfds ; i++) {
+		kfds[i].fd = get_fs_long((unsigned long *) &fds[i].fd);
+		kfds[i].events = get_fs_word((unsigned short *) &fds[i].events);
+	}
+	if (timeout > 0)
+		current->timeout = jiffies + MSECS_TO_CT(timeout);
+	cli();
+	count = do_poll(kfds, nfds, timeout);
+	sti();
+	current->timeout = 0;
+	for (i = 0 ; i < nfds ; i++)
+		put_fs_word(kfds[i].revents, (short *) &fds[i].revents);
+	if (!count && (current->signal & ~current->blocked))
+		return -EINTR;
+	return count;
+}
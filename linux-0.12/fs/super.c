@@ -193,6 +193,7 @@ int sys_umount(char * dev_name)
 	sb->s_isup = NULL;
 	put_super(dev);
 	sync_dev(dev);
+	invalidate_dev_pages(dev);
 	return 0;
 }
 
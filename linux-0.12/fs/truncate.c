@@ -24,7 +24,7 @@ static int free_ind(int dev,int block)
 			if (*p)
 				if (free_block(dev,*p)) {
 					*p = 0;
-					bh->b_dirt = 1;
+					mark_buffer_dirty(bh);
 				} else
 					block_busy = 1;
 		brelse(bh);
@@ -51,7 +51,7 @@ static int free_dind(int dev,int block)
 			if (*p)
 				if (free_ind(dev,*p)) {
 					*p = 0;
-					bh->b_dirt = 1;
+					mark_buffer_dirty(bh);
 				} else
 					block_busy = 1;
 		brelse(bh);
@@ -70,6 +70,7 @@ void truncate(struct m_inode * inode)
 	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode) ||
 	     S_ISLNK(inode->i_mode)))
 		return;
+	invalidate_inode_pages(inode);
 repeat:
 	block_busy = 0;
 	for (i=0;i<7;i++)
@@ -28,6 +28,13 @@
 #define F_GETLK		5	/* not implemented */
 #define F_SETLK		6
 #define F_SETLKW	7
+#define F_SETPIPE_SZ	8	/* capacity of a pipe, in bytes */
+#define F_GETPIPE_SZ	9
+
+/* flags for splice */
+#define SPLICE_F_MOVE	1	/* a hint: whole pages are always moved */
+#define SPLICE_F_NONBLOCK 2	/* don't wait for the pipes */
+#define SPLICE_F_MORE	4	/* a hint, ignored */
 
 /* for F_[GET|SET]FL */
 #define FD_CLOEXEC	1	/* actually anything with low bit set goes */
@@ -16,6 +16,19 @@
 #define DEF_SETUPSEG	0x9020
 #define DEF_SYSSIZE	0x3000
 
+/*
+ * Pages that are swapped out are compressed into memory first, into a
+ * pool of up to this percentage of it (see mm/zswap.c). Only what doesn't
+ * fit, or doesn't compress, goes to the swap device. 0 turns it off.
+ */
+#define ZSWAP_PERCENT 25
+
+/*
+ * When the machine is idle, pages with the same contents are merged into
+ * one, write-protected (see mm/ksm.c). 0 turns it off.
+ */
+#define MERGE_PAGES 1
+
 /*
  * The root-device is no longer hard-coded. You can change the default
  * root-device by changing the line ROOT_DEV = XXX in boot/bootsect.s
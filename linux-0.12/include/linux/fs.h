@@ -44,7 +44,7 @@ void buffer_init(long buffer_end);
 #define NR_INODE 64
 #define NR_FILE 64
 #define NR_SUPER 8
-#define NR_HASH 307
+#define MIN_HASH_BITS 8
 #define NR_BUFFERS nr_buffers
 #define BLOCK_SIZE 1024
 #define BLOCK_SIZE_BITS 10
@@ -55,19 +55,50 @@ void buffer_init(long buffer_end);
 #define INODES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct d_inode)))
 #define DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE)/(sizeof (struct dir_entry)))
 
+/*
+ * A pipe is a ring of p_pages pages, PIPE_DEF_PAGES unless fcntl() says
+ * otherwise. The pages are only allocated when they're first written to.
+ * i_size points to the page with the rest, see fs/pipe.c.
+ */
+#define PIPE_DEF_PAGES	16
+#define PIPE_MAX_PAGES	256
+
+struct pipe_buf {
+	unsigned long p_head;		/* in bytes, from the first page */
+	unsigned long p_tail;
+	unsigned long p_size;		/* bytes in the pipe */
+	unsigned long p_pages;
+	unsigned char p_lock;
+	struct task_struct * p_wait;	/* for p_lock */
+	unsigned long p_page[PIPE_MAX_PAGES];
+};
+
+#define PIPE_INFO(inode) ((struct pipe_buf *) (inode).i_size)
 #define PIPE_READ_WAIT(inode) ((inode).i_wait)
 #define PIPE_WRITE_WAIT(inode) ((inode).i_wait2)
-#define PIPE_HEAD(inode) ((inode).i_zone[0])
-#define PIPE_TAIL(inode) ((inode).i_zone[1])
-#define PIPE_SIZE(inode) ((PIPE_HEAD(inode)-PIPE_TAIL(inode))&(PAGE_SIZE-1))
-#define PIPE_EMPTY(inode) (PIPE_HEAD(inode)==PIPE_TAIL(inode))
-#define PIPE_FULL(inode) (PIPE_SIZE(inode)==(PAGE_SIZE-1))
+#define PIPE_HEAD(inode) (PIPE_INFO(inode)->p_head)
+#define PIPE_TAIL(inode) (PIPE_INFO(inode)->p_tail)
+#define PIPE_LIMIT(inode) (PIPE_INFO(inode)->p_pages*PAGE_SIZE)
+#define PIPE_SIZE(inode) (PIPE_INFO(inode)->p_size)
+#define PIPE_EMPTY(inode) (!PIPE_SIZE(inode))
+#define PIPE_FULL(inode) (PIPE_SIZE(inode)>=PIPE_LIMIT(inode))
+/* a page lent by splice() or tee(): nobody writes to it, see fs/pipe.c */
+#define PIPE_BORROWED	1
+/* if write() can go on: a borrowed page at the head blocks it too */
+#define pipe_room(inode) (!PIPE_FULL(inode) && \
+	!(PIPE_INFO(inode)->p_page[PIPE_HEAD(inode)>>12] & PIPE_BORROWED))
 
 #define NIL_FILP	((struct file *)0)
 #define SEL_IN		1
 #define SEL_OUT		2
 #define SEL_EX		4
 
+/* the lru lists of unused buffers, see fs/buffer.c */
+#define BUF_CLEAN	0
+#define BUF_DIRTY	1
+#define BUF_LOCKED	2
+#define NR_LIST		3
+
 typedef char buffer_block[BLOCK_SIZE];
 
 struct buffer_head {
@@ -78,11 +109,15 @@ struct buffer_head {
 	unsigned char b_dirt;		/* 0-clean,1-dirty */
 	unsigned char b_count;		/* users using this block */
 	unsigned char b_lock;		/* 0 - ok, 1 -locked */
+	unsigned char b_list;		/* BUF_xxx list, when unused */
+	unsigned long b_dirttime;	/* jiffies when it was first dirtied */
 	struct task_struct * b_wait;
 	struct buffer_head * b_prev;
 	struct buffer_head * b_next;
 	struct buffer_head * b_prev_free;
 	struct buffer_head * b_next_free;
+	struct buffer_head * b_this_page;	/* buffers sharing a page, or NULL */
+	struct buffer_head * b_next_all;	/* every buffer head there is */
 };
 
 struct d_inode {
@@ -117,6 +152,8 @@ struct m_inode {
 	unsigned char i_mount;
 	unsigned char i_seek;
 	unsigned char i_update;
+	unsigned long i_ra_offset;	/* last demand-load fault */
+	unsigned short i_ra_pages;	/* read-ahead window, in pages */
 };
 
 struct file {
@@ -170,6 +207,7 @@ extern struct file file_table[NR_FILE];
 extern struct super_block super_block[NR_SUPER];
 extern struct buffer_head * start_buffer;
 extern int nr_buffers;
+extern int nr_buffers_dirty;
 
 extern void check_disk_change(int dev);
 extern int floppy_change(unsigned int nr);
@@ -189,14 +227,40 @@ extern void iput(struct m_inode * inode);
 extern struct m_inode * iget(int dev,int nr);
 extern struct m_inode * get_empty_inode(void);
 extern struct m_inode * get_pipe_inode(void);
+extern int file_poll(struct file * filp,
+	struct task_struct *** in, struct task_struct *** out);
+extern int poll_watches;
+extern void poll_wake(struct task_struct ** queue);
+extern void epoll_release(struct file * filp);
 extern struct buffer_head * get_hash_table(int dev, int block);
 extern struct buffer_head * getblk(int dev, int block);
 extern void ll_rw_block(int rw, struct buffer_head * bh);
 extern void ll_rw_page(int rw, int dev, int nr, char * buffer);
+extern void ll_rw_pages(int rw, int dev, int page, char * buffer, int nr);
+extern void ll_rw_swap_file(int rw, int dev, int * b, int nr, char * buffer);
 extern void brelse(struct buffer_head * buf);
+extern void mark_buffer_dirty(struct buffer_head * bh);
+extern void mark_buffer_clean(struct buffer_head * bh);
+extern void balance_dirty(void);
+extern void show_buffers(void);
+extern int shrink_buffers(int pages);
+extern unsigned long get_cached_page(struct m_inode * inode,
+	unsigned long offset);
+extern unsigned long find_cached_page(struct m_inode * inode,
+	unsigned long offset);
+extern void page_read_ahead(struct m_inode * inode, unsigned long offset);
+extern unsigned long read_cached_page(struct m_inode * inode,
+	unsigned long pos, int * off);
+extern void update_cached_pages(struct m_inode * inode, unsigned long pos,
+	char * data, int count);
+extern void invalidate_inode_pages(struct m_inode * inode);
+extern void invalidate_dev_pages(int dev);
+extern int shrink_page_cache(int pages);
+extern void show_page_cache(void);
 extern struct buffer_head * bread(int dev,int block);
 extern void bread_page(unsigned long addr,int dev,int b[4]);
 extern struct buffer_head * breada(int dev,int block,...);
+extern void bread_ahead(int dev,int block);
 extern int new_block(int dev);
 extern int free_block(int dev, int block);
 extern struct m_inode * new_inode(int dev);
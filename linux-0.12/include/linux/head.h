@@ -6,6 +6,7 @@ typedef struct desc_struct {
 } desc_table[256];
 
 extern unsigned long pg_dir[1024];
+extern char empty_zero_page[4096];
 extern desc_table idt,gdt;
 
 #define GDT_NUL 0
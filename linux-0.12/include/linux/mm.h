@@ -8,14 +8,38 @@
 
 extern int SWAP_DEV;
 
-#define read_swap_page(nr,buffer) ll_rw_page(READ,SWAP_DEV,(nr),(buffer));
-#define write_swap_page(nr,buffer) ll_rw_page(WRITE,SWAP_DEV,(nr),(buffer));
+extern void rw_swap_pages(int rw, int swap_nr, char * buffer, int nr);
+#define read_swap_page(nr,buffer) rw_swap_pages(READ,(nr),(buffer),1)
+#define write_swap_page(nr,buffer) rw_swap_pages(WRITE,(nr),(buffer),1)
+
+/* get_free_pages() can give up to 2^(NR_MEM_ORDERS-1) contiguous pages */
+#define NR_MEM_ORDERS	8
 
 extern unsigned long get_free_page(void);
+extern unsigned long get_zeroed_page(void);
+extern int shrink_zeroed_pages(int pages);
+extern void idle_zero_page(void);
+extern unsigned long get_free_pages(int order);
+extern unsigned long alloc_pages(int order);
+extern void free_pages(unsigned long addr, int order);
 extern unsigned long put_dirty_page(unsigned long page,unsigned long address);
+extern unsigned long get_page_dir(void);
 extern void free_page(unsigned long addr);
 void swap_free(int page_nr);
 void swap_in(unsigned long *table_ptr);
+extern void swap_duplicate(int swap_nr);
+extern void show_swap(void);
+extern int zswap_store(unsigned long page, int * freed);
+extern void zswap_load(int nr, char * page);
+extern void zswap_free(int nr);
+extern void zswap_duplicate(int nr);
+extern void zswap_init(void);
+extern void show_zswap(void);
+extern int shrink_merged_pages(int pages);
+extern void idle_merge_pages(void);
+extern void ksm_init(void);
+extern void show_ksm(void);
+extern void un_wp_table(unsigned long * dir_entry);
 
 extern inline volatile void oom(void)
 {
@@ -24,17 +48,65 @@ extern inline volatile void oom(void)
 }
 
 #define invalidate() \
-__asm__("movl %%eax,%%cr3"::"a" (0))
+__asm__("movl %%cr3,%%eax\n\tmovl %%eax,%%cr3":::"ax")
+
+/* the entry for a linear address in the page directory of a task */
+#define PAGE_DIR_OFFSET(tsk,address) \
+((unsigned long *) ((tsk)->tss.cr3 + (((address)>>20) & 0xffc)))
 
 /* these are not to be changed without changing head.s etc */
 #define LOW_MEM 0x100000
 extern unsigned long HIGH_MEMORY;
-#define PAGING_MEMORY (15*1024*1024)
-#define PAGING_PAGES (PAGING_MEMORY>>12)
+extern unsigned long nr_free_pages;
+/*
+ * All of memory is identity-mapped in the kernel part of the page
+ * directories, below TASK_BASE (see linux/sched.h): that's as much as we
+ * can use. How much there is gets decided at boot, see mem_init().
+ */
+#define MAX_MEMORY TASK_BASE
+extern unsigned long paging_pages;
+#define PAGING_PAGES paging_pages
+#define PAGING_MEMORY (PAGING_PAGES<<12)
 #define MAP_NR(addr) (((addr)-LOW_MEM)>>12)
 #define USED 100
 
-extern unsigned char mem_map [ PAGING_PAGES ];
+extern unsigned char * mem_map;
+
+/*
+ * mem_map[] is a char. The users of a page that isn't limited by
+ * NR_TASKS (a cached page can be mapped any number of times) stop at
+ * PAGE_MAX_SHARE, well below USED: anybody else gets a copy.
+ */
+#define PAGE_MAX_SHARE	64
+
+/*
+ * Every page also has an age, for swap_out(): it goes up each time the
+ * clock finds the page accessed, and down each time it doesn't. Only a
+ * page that has aged all the way down is thrown out.
+ */
+#define PAGE_INITIAL_AGE	3
+#define PAGE_ADVANCE		3
+#define PAGE_DECLINE		1
+#define PAGE_MAX_AGE		20
+
+extern unsigned char * page_age;
+
+/*
+ * An area of a task mapped with mmap(). Addresses are relative to the
+ * start of the task, and the list of a task is sorted by them.
+ */
+struct vm_area_struct {
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_offset;	/* in the file, of vm_start */
+	struct m_inode * vm_inode;	/* NULL for anonymous memory */
+	unsigned short vm_flags;
+	struct vm_area_struct * vm_next;
+};
+
+#define VM_READ		1
+#define VM_WRITE	2
+#define VM_SHARED	4
 
 #define PAGE_DIRTY	0x40
 #define PAGE_ACCESSED	0x20
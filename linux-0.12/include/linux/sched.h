@@ -3,12 +3,19 @@
 
 #define HZ 100
 
-#define NR_TASKS	64
-#define TASK_SIZE	0x04000000
+/*
+ * Every task has a page directory of its own. The bottom TASK_BASE bytes
+ * of it map the kernel and all of physical memory, the same in every
+ * task, and user space is the TASK_SIZE bytes after that: 1Gb and 3Gb,
+ * less the last 4Mb, so that TASK_BASE+TASK_SIZE doesn't wrap round.
+ */
+#define NR_TASKS	128
+#define TASK_BASE	0x40000000
+#define TASK_SIZE	0xBFC00000
 #define LIBRARY_SIZE	0x00400000
 
-#if (TASK_SIZE & 0x3fffff)
-#error "TASK_SIZE must be multiple of 4M"
+#if ((TASK_BASE | TASK_SIZE) & 0x3fffff)
+#error "TASK_BASE and TASK_SIZE must be multiples of 4M"
 #endif
 
 #if (LIBRARY_SIZE & 0x3fffff)
@@ -19,14 +26,16 @@
 #error "LIBRARY_SIZE too damn big!"
 #endif
 
-#if (((TASK_SIZE>>16)*NR_TASKS) != 0x10000)
-#error "TASK_SIZE*NR_TASKS must be 4GB"
+#if ((TASK_BASE>>16) + (TASK_SIZE>>16) > 0x10000)
+#error "TASK_BASE+TASK_SIZE must fit in 4GB"
 #endif
 
 #define LIBRARY_OFFSET (TASK_SIZE - LIBRARY_SIZE)
 
 #define CT_TO_SECS(x)	((x) / HZ)
 #define CT_TO_USECS(x)	(((x) % HZ) * 1000000/HZ)
+/* milliseconds to ticks, rounded up: for poll() and epoll_wait() */
+#define MSECS_TO_CT(x)	((x) / 1000 * HZ + (((x) % 1000) * HZ + 999) / 1000)
 
 #define FIRST_TASK task[0]
 #define LAST_TASK task[NR_TASKS-1]
@@ -53,8 +62,10 @@
 #define NULL ((void *) 0)
 #endif
 
-extern int copy_page_tables(unsigned long from, unsigned long to, long size);
-extern int free_page_tables(unsigned long from, unsigned long size);
+extern int copy_page_tables(struct task_struct * p, unsigned long from,
+	unsigned long to, unsigned long size);
+extern int free_page_tables(struct task_struct * p, unsigned long from,
+	unsigned long size);
 
 extern void sched_init(void);
 extern void schedule(void);
@@ -121,6 +132,8 @@ struct task_struct {
 	 * p->p_pptr->pid)
 	 */
 	struct task_struct	*p_pptr, *p_cptr, *p_ysptr, *p_osptr;
+	struct task_struct	*vfork_wait;	/* see vfork() in kernel/fork.c */
+	int vfork_error;	/* why the exec of a spawn() child failed */
 	unsigned short uid,euid,suid;
 	unsigned short gid,egid,sgid;
 	unsigned long timeout,alarm;
@@ -135,6 +148,7 @@ struct task_struct {
 	struct m_inode * root;
 	struct m_inode * executable;
 	struct m_inode * library;
+	struct vm_area_struct * mmap;	/* see mm/mmap.c */
 	unsigned long close_on_exec;
 	struct file * filp[NR_OPEN];
 /* ldt for this task 0 - zero 1 - cs 2 - ds&ss */
@@ -148,6 +162,7 @@ struct task_struct {
  */
 #define PF_ALIGNWARN	0x00000001	/* Print alignment warning msgs */
 					/* Not implemented yet, only for 486*/
+#define PF_VFORK	0x00000002	/* Borrows the memory of its parent */
 
 /*
  *  INIT_TASK is used to set up the first task table, touch at
@@ -159,7 +174,7 @@ struct task_struct {
 /* ec,brk... */	0,0,0,0,0,0, \
 /* pid etc.. */	0,0,0,0, \
 /* suppl grps*/ {NOGROUP,}, \
-/* proc links*/ &init_task.task,0,0,0, \
+/* proc links*/ &init_task.task,0,0,0,0,0, \
 /* uid etc */	0,0,0,0,0,0, \
 /* timeout */	0,0,0,0,0,0,0, \
 /* rlimits */   { {0x7fffffff, 0x7fffffff}, {0x7fffffff, 0x7fffffff},  \
@@ -167,7 +182,7 @@ struct task_struct {
 		  {0x7fffffff, 0x7fffffff}, {0x7fffffff, 0x7fffffff}}, \
 /* flags */	0, \
 /* math */	0, \
-/* fs info */	-1,0022,NULL,NULL,NULL,NULL,0, \
+/* fs info */	-1,0022,NULL,NULL,NULL,NULL,NULL,0, \
 /* filp */	{NULL,}, \
 	{ \
 		{0,0}, \
@@ -196,6 +211,10 @@ extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
 extern int in_group_p(gid_t grp);
+extern struct vm_area_struct * find_vma(struct task_struct * p, unsigned long addr);
+extern int copy_mmap(struct task_struct * p);
+extern void exit_mmap(void);
+extern void end_vfork(void);
 
 /*
  * Entry into gdt where to find first TSS. 0-nul, 1-cs, 2-ds, 3-syscall
@@ -89,6 +89,21 @@ extern int sys_symlink();
 extern int sys_lstat();
 extern int sys_readlink();
 extern int sys_uselib();
+extern int sys_bdflush();
+extern int sys_mmap();
+extern int sys_munmap();
+extern int sys_msync();
+extern int sys_vfork();
+extern int sys_spawn();
+extern int sys_swapon();
+extern int sys_swapoff();
+extern int sys_splice();
+extern int sys_tee();
+extern int sys_sendfile();
+extern int sys_epoll_create();
+extern int sys_epoll_ctl();
+extern int sys_epoll_wait();
+extern int sys_poll();
 
 fn_ptr sys_call_table[] = { sys_setup, sys_exit, sys_fork, sys_read,
 sys_write, sys_open, sys_close, sys_waitpid, sys_creat, sys_link,
@@ -105,7 +120,10 @@ sys_getpgrp, sys_setsid, sys_sigaction, sys_sgetmask, sys_ssetmask,
 sys_setreuid,sys_setregid, sys_sigsuspend, sys_sigpending, sys_sethostname,
 sys_setrlimit, sys_getrlimit, sys_getrusage, sys_gettimeofday, 
 sys_settimeofday, sys_getgroups, sys_setgroups, sys_select, sys_symlink,
-sys_lstat, sys_readlink, sys_uselib };
+sys_lstat, sys_readlink, sys_uselib, sys_bdflush, sys_mmap, sys_munmap, sys_msync,
+sys_vfork, sys_spawn, sys_swapon, sys_swapoff, sys_splice, sys_tee,
+sys_sendfile, sys_epoll_create, sys_epoll_ctl, sys_epoll_wait,
+sys_poll };
 
 /* So we don't have to do any more manual updating.... */
 //NR = number
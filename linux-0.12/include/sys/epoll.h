@@ -0,0 +1,32 @@
+#ifndef _SYS_EPOLL_H
+#define _SYS_EPOLL_H
+
+#define EPOLLIN		0x001	/* there is something to read */
+#define EPOLLPRI	0x002
+#define EPOLLOUT	0x004	/* writing won't block */
+#define EPOLLERR	0x008	/* a pipe nobody reads any more */
+#define EPOLLHUP	0x010	/* a pipe nobody writes to any more */
+#define EPOLLET		0x80000000	/* only report changes */
+
+/* ops for epoll_ctl */
+#define EPOLL_CTL_ADD	1
+#define EPOLL_CTL_DEL	2
+#define EPOLL_CTL_MOD	3
+
+typedef union epoll_data {
+	void * ptr;
+	int fd;
+	unsigned long u32;
+} epoll_data_t;
+
+struct epoll_event {
+	unsigned long events;
+	epoll_data_t data;
+};
+
+int epoll_create(int size);
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event * event);
+int epoll_wait(int epfd, struct epoll_event * events, int maxevents,
+	int timeout);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef _SYS_MMAN_H
+#define _SYS_MMAN_H
+
+#include <sys/types.h>
+
+#define PROT_NONE	0
+#define PROT_READ	1
+#define PROT_WRITE	2
+#define PROT_EXEC	4
+
+#define MAP_SHARED	1	/* writes go to the file */
+#define MAP_PRIVATE	2	/* writes go to a private copy */
+#define MAP_TYPE	0x0f
+#define MAP_FIXED	0x10	/* exactly at addr, or not at all */
+#define MAP_ANONYMOUS	0x20	/* no file: zero-filled (private only) */
+
+#define MAP_FAILED	((void *) -1)
+
+/* flags for msync */
+#define MS_ASYNC	1
+#define MS_INVALIDATE	2
+#define MS_SYNC		4
+
+void * mmap(void * addr, size_t len, int prot, int flags, int fd, off_t off);
+int munmap(void * addr, size_t len);
+int msync(void * addr, size_t len, int flags);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _SYS_POLL_H
+#define _SYS_POLL_H
+
+/* the same bits as EPOLLXX */
+#define POLLIN		0x001	/* there is something to read */
+#define POLLPRI		0x002
+#define POLLOUT		0x004	/* writing won't block */
+#define POLLERR		0x008	/* a pipe nobody reads any more */
+#define POLLHUP		0x010	/* a pipe nobody writes to any more */
+#define POLLNVAL	0x020	/* fd isn't open */
+
+struct pollfd {
+	int fd;			/* ignored if negative */
+	short events;
+	short revents;
+};
+
+int poll(struct pollfd * fds, unsigned int nfds, int timeout);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef _SYS_SWAP_H
+#define _SYS_SWAP_H
+
+/* flags for swapon */
+#define SWAP_FLAG_PREFER	0x8000	/* the priority is in the low bits */
+#define SWAP_FLAG_PRIO_MASK	0x7fff
+
+int swapon(const char * path, int flags);
+int swapoff(const char * path);
+
+#endif
@@ -146,6 +146,21 @@
 #define __NR_lstat	84
 #define __NR_readlink	85
 #define __NR_uselib	86
+#define __NR_bdflush	87
+#define __NR_mmap	88
+#define __NR_munmap	89
+#define __NR_msync	90
+#define __NR_vfork	91
+#define __NR_spawn	92
+#define __NR_swapon	93
+#define __NR_swapoff	94
+#define __NR_splice	95
+#define __NR_tee	96
+#define __NR_sendfile	97
+#define __NR_epoll_create 98
+#define __NR_epoll_ctl	99
+#define __NR_epoll_wait	100
+#define __NR_poll	101
 
 #define _syscall0(type,name) \
 type name(void) \
@@ -216,6 +231,9 @@ int close(int fildes);
 int creat(const char * filename, mode_t mode);
 int dup(int fildes);
 int execve(const char * filename, char ** argv, char ** envp);
+int spawn(const char * filename, char ** argv, char ** envp);
+int splice(int fd_in, off_t * off_in, int fd_out, off_t * off_out,
+	int len, unsigned int flags);
 int execv(const char * pathname, char ** argv);
 int execvp(const char * file, char ** argv);
 int execl(const char * pathname, char * arg0, ...);
@@ -225,6 +243,7 @@ volatile void exit(int status);
 volatile void _exit(int status);
 int fcntl(int fildes, int cmd, ...);
 int fork(void);
+int vfork(void);
 int getpid(void);
 int getuid(void);
 int geteuid(void);
@@ -250,6 +269,7 @@ int stat(const char * filename, struct stat * stat_buf);
 int fstat(int fildes, struct stat * stat_buf);
 int stime(time_t * tptr);
 int sync(void);
+int tee(int fd_in, int fd_out, int len);
 time_t time(time_t * tloc);
 time_t times(struct tms * tbuf);
 int ulimit(int cmd, long limit);
@@ -274,6 +294,7 @@ int gettimeofday(struct timeval *tv, struct timezone *tz);
 int settimeofday(struct timeval *tv, struct timezone *tz);
 int getgroups(int gidsetlen, gid_t *gidset);
 int setgroups(int gidsetlen, gid_t *gidset);
+int sendfile(int out_fd, int in_fd, off_t * offset, int count);
 int select(int width, fd_set * readfds, fd_set * writefds,
 	fd_set * exceptfds, struct timeval * timeout);
 
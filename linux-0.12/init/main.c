@@ -29,6 +29,7 @@ static inline _syscall0(int,fork)
 static inline _syscall0(int,pause)
 static inline _syscall1(int,setup,void *,BIOS)
 static inline _syscall0(int,sync)
+static inline _syscall0(int,bdflush)
 
 #include <linux/tty.h>
 #include <linux/sched.h>
@@ -55,7 +56,7 @@ extern void blk_dev_init(void);			//
 extern void chr_dev_init(void);			//ַ豸ʼ chr_drv/tty_io.c
 extern void hd_init(void);					//Ӳ̳ʼ	blk_drv/hd.c
 extern void floppy_init(void);			//ʼ blk_drv/floppy.c
-extern void mem_init(long start, long end);			//ڴʼ mm/memory.c
+extern long mem_init(long start, long end);			//ڴʼ mm/memory.c
 extern long rd_init(long mem_start, int length);	//̳ʼ blk_drv/ramdisk.c
 extern long kernel_mktime(struct tm * tm);		//ϵͳʱ()
 
@@ -76,6 +77,7 @@ static int sprintf(char * str, const char *fmt, ...)
  */
  // Щںڼ setup.s á
 #define EXT_MEM_K (*(unsigned short *)0x90002)	//1MB ԺչڴС(KB)
+#define ALT_MEM_K (*(unsigned long *)0x901E0)	/* memory above 1Mb (kB), from int 0x15 0xe801 */
 #define CON_ROWS ((*(unsigned short *)0x9000e) & 0xff)	//ѡĿ̨Ļ
 #define CON_COLS (((*(unsigned short *)0x9000e) & 0xff00) >> 8)
 #define DRIVE_INFO (*(struct drive_info *)0x90080)	//Ӳ̲32ֽ
@@ -164,23 +166,20 @@ void main(void)		/* This really IS void, no error here. */
 	// ٻĩ˵ַ > buffer_memory_end
 	// ڴ > memory_end
 	// ڴ濪ʼַ > main_memory_start
-	memory_end = (1<<20) + (EXT_MEM_K<<10); //1M + չڴС
+	memory_end = ALT_MEM_K ? ALT_MEM_K : EXT_MEM_K;
+	if (memory_end > (MAX_MEMORY>>10) - 1024)
+		memory_end = (MAX_MEMORY>>10) - 1024;
+	memory_end = (1<<20) + (memory_end<<10); //1M + չڴС
 	memory_end &= 0xfffff000;			//Բ4K(1ҳ)ڴ
-	if (memory_end > 16*1024*1024)
-		memory_end = 16*1024*1024;
-	if (memory_end > 12*1024*1024)
-		buffer_memory_end = 4*1024*1024;
-	else if (memory_end > 6*1024*1024)
-		buffer_memory_end = 2*1024*1024;
-	else
-		buffer_memory_end = 1*1024*1024;
+/* only a minimal cache here: the rest grows on demand, see fs/buffer.c */
+	buffer_memory_end = 1*1024*1024;
 	main_memory_start = buffer_memory_end;	//ڴ濪ʼַ = ٻַ
 #ifdef RAMDISK	//̣ڴ滹Ӧ
 	main_memory_start += rd_init(main_memory_start, RAMDISK*1024);
 #endif
 
 // ں˽зĳʼ̡
-	mem_init(main_memory_start,memory_end);		//ڴʼ
+	main_memory_start = mem_init(main_memory_start,memory_end);		//ڴʼ
 	trap_init();		//ųʼ
 	blk_dev_init();	//豸ʼ
 	chr_dev_init();	//ַ豸ʼ
@@ -250,6 +249,14 @@ void init(void)
 		NR_BUFFERS*BLOCK_SIZE);
 	printf("Free mem: %d bytes\n\r",memory_end-main_memory_start);
 
+	if (!(pid=fork())) {
+		close(0);		/* the flusher has no use for the tty */
+		close(1);
+		close(2);
+		bdflush();		/* only returns if killed */
+		_exit(1);
+	}
+
 //ͨfork()ڴһӽ( 2)ڱӽ̣fork() 0 ֵ
 //ԭ򷵻ӽ̵Ľ̺ pid
 //ӽ( 2)رվ 0 (stdin)ֻʽ /etc/rc ļʹexecve()
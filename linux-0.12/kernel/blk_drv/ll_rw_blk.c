@@ -80,7 +80,7 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 	req->next = NULL;
 	cli();
 	if (req->bh)
-		req->bh->b_dirt = 0;
+		mark_buffer_clean(req->bh);
 	if (!(tmp = dev->current_request)) {
 		dev->current_request = req;
 		sti();
@@ -160,17 +160,16 @@ repeat:
 	add_request(major+blk_dev,req);
 }
 
-void ll_rw_page(int rw, int dev, int page, char * buffer)
+/*
+ * Swap requests have no buffer head, and go before the other requests in
+ * the order they come (see add_request()), so waiting for the last of a
+ * row of them is waiting for them all: only that one has 'wait' set.
+ */
+static void swap_request(int rw, int dev, unsigned long sector,
+	unsigned long nr_sectors, char * buffer, int wait)
 {
 	struct request * req;
-	unsigned int major = MAJOR(dev);
 
-	if (major >= NR_BLK_DEV || !(blk_dev[major].request_fn)) {
-		printk("Trying to read nonexistent block-device\n\r");
-		return;
-	}
-	if (rw!=READ && rw!=WRITE)
-		panic("Bad block dev command, must be R/W");
 repeat:
 	req = request+NR_REQUEST;
 	while (--req >= request)
@@ -184,16 +183,67 @@ repeat:
 	req->dev = dev;
 	req->cmd = rw;
 	req->errors = 0;
-	req->sector = page<<3;
-	req->nr_sectors = 8;
+	req->sector = sector;
+	req->nr_sectors = nr_sectors;
 	req->buffer = buffer;
-	req->waiting = current;
+	req->waiting = wait ? current : NULL;
 	req->bh = NULL;
 	req->next = NULL;
-	current->state = TASK_UNINTERRUPTIBLE;
-	add_request(major+blk_dev,req);
-	schedule();
-}	
+	if (wait)
+		current->state = TASK_UNINTERRUPTIBLE;
+	add_request(MAJOR(dev)+blk_dev,req);
+	if (wait)
+		schedule();
+}
+
+static int bad_swap_request(int rw, int dev)
+{
+	unsigned int major = MAJOR(dev);
+
+	if (major >= NR_BLK_DEV || !(blk_dev[major].request_fn)) {
+		printk("Trying to read nonexistent block-device\n\r");
+		return 1;
+	}
+	if (rw!=READ && rw!=WRITE)
+		panic("Bad block dev command, must be R/W");
+	return 0;
+}
+
+/*
+ * ll_rw_pages() reads or writes 'nr' pages from 'page' on, to or from
+ * 'buffer', in one request, and waits for it.
+ */
+void ll_rw_pages(int rw, int dev, int page, char * buffer, int nr)
+{
+	if (!bad_swap_request(rw,dev))
+		swap_request(rw,dev,page<<3,nr<<3,buffer,1);
+}
+
+/*
+ * ll_rw_swap_file() does the same for a swap file: 'b' has the 'nr'
+ * blocks that go to or from 'buffer', one after the other. Blocks that
+ * follow each other on the disk go in one request.
+ */
+void ll_rw_swap_file(int rw, int dev, int * b, int nr, char * buffer)
+{
+	int i;
+
+	if (bad_swap_request(rw,dev))
+		return;
+	while (nr > 0) {
+		for (i = 1 ; i < nr && b[i] == b[0] + i ; i++)
+			/* nothing */ ;
+		swap_request(rw,dev,b[0]<<1,i<<1,buffer,i == nr);
+		buffer += i*BLOCK_SIZE;
+		b += i;
+		nr -= i;
+	}
+}
+
+void ll_rw_page(int rw, int dev, int page, char * buffer)
+{
+	ll_rw_pages(rw,dev,page,buffer,1);
+}
 
 void ll_rw_block(int rw, struct buffer_head * bh)
 {
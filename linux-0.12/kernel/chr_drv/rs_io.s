@@ -122,8 +122,9 @@ write_char:
 	ja 1f
 	movl proc_list(%ecx),%ebx	# wake up sleeping process
 	testl %ebx,%ebx			# is there any?
-	je 1f
+	je 2f
 	movl $0,(%ebx)
+2:	call poll_write_q
 1:	movl tail(%ecx),%ebx
 	movb buf(%ecx,%ebx),%al
 	outb %al,%dx
@@ -139,10 +140,29 @@ write_buffer_empty:
 	testl %ebx,%ebx			# is there any?
 	je 1f
 	movl $0,(%ebx)
-1:	incl %edx
+1:	call poll_write_q
+	incl %edx
 	inb %dx,%al
 	jmp 1f
 1:	jmp 1f
 1:	andb $0xd,%al		/* disable transmit interrupt */
 	outb %al,%dx
 	ret
+
+/*
+ * The write queue has room again: tell poll_wake(), if anyone is
+ * polling at all. %ecx and %edx are still needed.
+ */
+.align 2
+poll_write_q:
+	cmpl $0,_poll_watches
+	je 1f
+	pushl %ecx
+	pushl %edx
+	leal proc_list(%ecx),%eax
+	pushl %eax
+	call _poll_wake
+	addl $4,%esp
+	popl %edx
+	popl %ecx
+1:	ret
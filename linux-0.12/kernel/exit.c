@@ -38,6 +38,7 @@ void release(struct task_struct * p)
 				p->p_ysptr->p_osptr = p->p_osptr;
 			else
 				p->p_pptr->p_cptr = p->p_osptr;
+			free_page(p->tss.cr3);
 			free_page((long)p);
 			schedule();
 			return;
@@ -264,8 +265,16 @@ volatile void do_exit(long code)
 	struct task_struct *p;
 	int i;
 
-	free_page_tables(get_base(current->ldt[1]),get_limit(0x0f));
-	free_page_tables(get_base(current->ldt[2]),get_limit(0x17));
+	if (current->flags & PF_VFORK) {
+/* the memory is our parent's: keep just the kernel, and give it back */
+		current->tss.cr3 = (long) pg_dir;
+		__asm__("movl %%eax,%%cr3"::"a" (pg_dir));
+		end_vfork();
+	} else {
+		exit_mmap();
+		free_page_tables(current,get_base(current->ldt[1]),get_limit(0x0f));
+		free_page_tables(current,get_base(current->ldt[2]),get_limit(0x17));
+	}
 	for (i=0 ; i<NR_OPEN ; i++)
 		if (current->filp[i])
 			sys_close(i);
@@ -18,6 +18,22 @@
 #include <asm/system.h> // 系统头文件。定义了设置或修改描述符/中断门等的嵌入式汇编宏。
 
 extern void write_verify(unsigned long address); // 写页面验证。若页面不可写，则复制页面。
+extern void spawn_child(void);
+
+/*
+ * How copy_process() was called (see sys_call.s). vfork() gives the
+ * child the memory of its parent - the same page directory and mappings,
+ * nothing copied - and the parent waits until the child has exec'd or
+ * exited, at which point the child gives it back (end_vfork()). Only
+ * SIGKILL gets to the parent meanwhile: it can't die while the child is
+ * on its memory, so the child is killed too, and waited for. spawn()
+ * is a vfork() whose child starts in the kernel, at spawn_child, and
+ * does the execve() straight away. If that fails, spawn() returns the
+ * error instead of a pid, and the child is left to init to reap.
+ */
+#define DO_FORK		0
+#define DO_VFORK	1
+#define DO_SPAWN	2
 
 long last_pid=0; // 最新进程号，其值会由 get_empty_process()生成。
 
@@ -61,6 +77,7 @@ int copy_mem(int nr,struct task_struct * p)
 {
 	unsigned long old_data_base,new_data_base,data_limit;
 	unsigned long old_code_base,new_code_base,code_limit;
+	unsigned long dir;
 
 	code_limit=get_limit(0x0f); //取当前进程局部描述符表中代码段描述符项中的段限长
 	data_limit=get_limit(0x17); //数据段描述符
@@ -70,12 +87,16 @@ int copy_mem(int nr,struct task_struct * p)
 		panic("We don't support separate I&D"); //内核显示出错信息，停止运行
 	if (data_limit < code_limit) //数据段的长度不小于代码段的长度
 		panic("Bad data_limit");
-	new_data_base = new_code_base = nr * TASK_SIZE; //设置创建中的新进程在线性地址空间中的基地址等于（64MB * 其任务号）
+	new_data_base = new_code_base = TASK_BASE;
 	p->start_code = new_code_base; //设置新进程局部描述符表中段描述符中的基地址。
 	set_base(p->ldt[1],new_code_base); //复制当前进程（父进程）的页目录表项和页表项。
 	set_base(p->ldt[2],new_data_base); //此时子进程共享父进程的内存页面
-	if (copy_page_tables(old_data_base,new_data_base,data_limit)) { //若出错
-		free_page_tables(new_data_base,data_limit); //释放刚申请的页表项。
+	if (!(dir = get_page_dir()))
+		return -ENOMEM;
+	p->tss.cr3 = dir;
+	if (copy_page_tables(p,old_data_base,new_data_base,data_limit)) { //若出错
+		free_page_tables(p,new_data_base,data_limit); //释放刚申请的页表项。
+		free_page(dir);
 		return -ENOMEM;
 	}
 	return 0;
@@ -99,7 +120,7 @@ int copy_mem(int nr,struct task_struct * p)
 	其中参数 nr 是调用 find_empty_process()分配的任务数组项号。
  */
 
-int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
+int copy_process(int nr,long ebp,long edi,long esi,long gs,long mode,long none,
 		long ebx,long ecx,long edx, long orig_eax, 
 		long fs,long es,long ds,
 		long eip,long cs,long eflags,long esp,long ss)
@@ -107,6 +128,9 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	struct task_struct *p;
 	int i;
 	struct file *f;
+	unsigned long * stack;
+	long pid, blocked;
+	struct task_struct * init;
 /* 
 	首先为新任务数据结构分配内存。如果内存分配出错，则返回出错码并退出。然后将新任务
 	结构指针放入任务数组的 nr 项中。其中 nr 为任务号，由前面 find_empty_process()返回。
@@ -133,6 +157,12 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	p->utime = p->stime = 0;
 	p->cutime = p->cstime = 0;
 	p->start_time = jiffies;
+	p->vfork_wait = NULL;
+	p->vfork_error = 0;
+	if (mode == DO_FORK)
+		p->flags &= ~PF_VFORK;
+	else
+		p->flags |= PF_VFORK;
 /*
 	再修改任务状态段 TSS 数据。由于系统给任务结构 p 分配了 1 页新内存，所以 
 	(PAGE_SIZE + (long) p) 让 esp0 正好指向该页顶端。 ss0:esp0 用作程序在内核态
@@ -168,7 +198,34 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 	并复制页表。如果出错（返回值不是 0），则复位任务数组中相应项并释放为该新任务分配的
 	用于任务结构的内存页。
 */
-	if (copy_mem(nr,p)) {
+	if (mode == DO_SPAWN) {
+		stack = (unsigned long *) (PAGE_SIZE + (long) p);
+		*--stack = ss & 0xffff;
+		*--stack = esp;
+		*--stack = eflags;
+		*--stack = cs & 0xffff;
+		*--stack = eip;
+		*--stack = ds & 0xffff;
+		*--stack = es & 0xffff;
+		*--stack = fs & 0xffff;
+		*--stack = orig_eax;
+		*--stack = edx;
+		*--stack = ecx;
+		*--stack = ebx;
+		p->tss.esp = (long) stack;
+		p->tss.eip = (long) spawn_child;
+		p->tss.cs = 0x08;
+		p->tss.ss = p->tss.ds = p->tss.es = 0x10;
+		p->tss.fs = 0x17;
+	}
+	if (mode == DO_FORK && copy_mem(nr,p)) {
+		task[nr] = NULL;
+		free_page((long) p);
+		return -EAGAIN;
+	}
+	if (mode == DO_FORK && copy_mmap(p)) {
+		free_page_tables(p,get_base(p->ldt[2]),get_limit(0x17));
+		free_page(p->tss.cr3);
 		task[nr] = NULL;
 		free_page((long) p);
 		return -EAGAIN;
@@ -209,7 +266,64 @@ int copy_process(int nr,long ebp,long edi,long esi,long gs,long none,
 		p->p_osptr->p_ysptr = p;
 	current->p_cptr = p;
 	p->state = TASK_RUNNING;	/* do this last, just in case */
-	return last_pid;
+	pid = last_pid;
+	if (mode != DO_FORK) {
+		blocked = current->blocked;
+		current->blocked = ~(1<<(SIGKILL-1));
+		while (task[nr] == p && p->p_pptr == current &&
+		       (p->flags & PF_VFORK))
+			if (current->signal & (1<<(SIGKILL-1))) {
+				p->signal |= (1<<(SIGKILL-1));
+				if (p->state == TASK_STOPPED)
+					p->state = TASK_RUNNING;
+				sleep_on(&current->vfork_wait);
+			} else
+				interruptible_sleep_on(&current->vfork_wait);
+		current->blocked = blocked;
+	}
+	if (mode == DO_SPAWN && task[nr] == p && p->p_pptr == current &&
+	    p->vfork_error) {
+		pid = p->vfork_error;
+		if ((init = task[1]) != current) {
+			if (p->p_osptr)
+				p->p_osptr->p_ysptr = p->p_ysptr;
+			if (p->p_ysptr)
+				p->p_ysptr->p_osptr = p->p_osptr;
+			else
+				current->p_cptr = p->p_osptr;
+			p->p_pptr = init;
+			p->p_ysptr = NULL;
+			if (p->p_osptr = init->p_cptr)
+				p->p_osptr->p_ysptr = p;
+			init->p_cptr = p;
+			if (p->state == TASK_ZOMBIE)
+				init->signal |= (1<<(SIGCHLD-1));
+		}
+	}
+	return pid;
+}
+
+/*
+ * The child of spawn() comes here if its execve() failed (see sys_call.s):
+ * its parent returns the error, and it exits.
+ */
+void spawn_failed(int error)
+{
+	current->vfork_error = error;
+	do_exit(127<<8);
+}
+
+/*
+ * A vfork() child that execs or exits is done with the memory of its
+ * parent: let the parent go on.
+ */
+void end_vfork(void)
+{
+	if (!(current->flags & PF_VFORK))
+		return;
+	current->flags &= ~PF_VFORK;
+	current->mmap = NULL;
+	wake_up(&current->p_pptr->vfork_wait);
 }
 
 /*
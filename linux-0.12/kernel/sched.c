@@ -44,7 +44,7 @@ void show_task(int nr,struct task_struct * p)
 }
 
 // 显示所有任务的任务号、进程号、进程状态和内核堆栈空闲字节数（大约）。
-// NR_TASKS 是系统能容纳的最大进程(任务)数量(64 个)
+// NR_TASKS 是系统能容纳的最大进程(任务)数量(128 个)
 
 void show_state(void)
 {
@@ -216,6 +216,11 @@ int sys_pause(void)
 {
 	current->state = TASK_INTERRUPTIBLE;
 	schedule();
+/* task 0 only gets back here when nobody else can run */
+	if (current == task[0]) {
+		idle_zero_page();
+		idle_merge_pages();
+	}
 	return 0;
 }
 // 把当前任务置为指定的睡眠状态（可中断的或不可中断的），并让睡眠队列头指针指向当前任务。
@@ -289,6 +294,8 @@ void wake_up(struct task_struct **p)
 			printk("wake_up: TASK_ZOMBIE");
 		(**p).state=0;// 置为就绪状态 TASK_RUNNING。
 	}
+	if (poll_watches)
+		poll_wake(p);
 }
 
 /*
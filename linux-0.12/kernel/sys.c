@@ -228,7 +228,8 @@ int sys_times(struct tms * tbuf)
 int sys_brk(unsigned long end_data_seg)
 {
 	if (end_data_seg >= current->end_code &&
-	    end_data_seg < current->start_stack - 16384)
+	    end_data_seg < current->start_stack - 16384 &&
+	    (!current->mmap || end_data_seg <= current->mmap->vm_start))
 		current->brk = end_data_seg;
 	return current->brk;
 }
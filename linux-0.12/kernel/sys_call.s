@@ -33,6 +33,9 @@
 
 SIG_CHLD	= 17
 
+VFORK		= 1		# how copy_process() is called, see fork.c
+SPAWN		= 2
+
 EAX		= 0x00
 EBX		= 0x04
 ECX		= 0x08
@@ -69,6 +72,7 @@ ENOSYS = 38
  * strange reason. Urgel. Now I just ignore them.
  */
 .globl _system_call,_sys_fork,_timer_interrupt,_sys_execve
+.globl _sys_vfork,_sys_spawn,_spawn_child
 .globl _hd_interrupt,_floppy_interrupt,_parallel_interrupt
 .globl _device_not_available, _coprocessor_error
 
@@ -220,9 +224,16 @@ _sys_execve:
 
 .align 2
 _sys_fork:
-	call _find_empty_process
+	pushl $0
+	jmp 1f
+_sys_vfork:
+	pushl $VFORK
+	jmp 1f
+_sys_spawn:
+	pushl $SPAWN
+1:	call _find_empty_process
 	testl %eax,%eax
-	js 1f
+	js 2f
 	push %gs
 	pushl %esi
 	pushl %edi
@@ -230,7 +241,24 @@ _sys_fork:
 	pushl %eax
 	call _copy_process
 	addl $20,%esp
-1:	ret
+2:	addl $4,%esp
+	ret
+
+/*
+ * The child of spawn() starts here, in kernel mode, on a copy of the
+ * system call frame of its parent: it does the execve() asked for, and
+ * goes to user mode in the new program. If that fails, spawn_failed()
+ * tells the parent why, and exits.
+ */
+.align 2
+_spawn_child:
+	call _sys_execve
+	testl %eax,%eax
+	js 1f
+	pushl %eax
+	jmp ret_from_sys_call
+1:	pushl %eax
+	call _spawn_failed
 
 _hd_interrupt:
 	pushl %eax
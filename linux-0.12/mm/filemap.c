@@ -0,0 +1,466 @@
+/*
+ *  linux/mm/filemap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * The page cache keeps whole pages of regular files, indexed by inode
+ * and offset in the file. Demand-loading maps these pages straight into
+ * the process (write-protected: a write gets a private copy through
+ * do_wp_page()), and file_read() copies out of them. That way a file is
+ * read into memory once, instead of once into the buffer cache and once
+ * more for every process that runs it.
+ *
+ * The offsets are multiples of BLOCK_SIZE, not PAGE_SIZE, as the text of
+ * a demand-loaded executable starts one block into the file, after the
+ * a.out header.
+ *
+ * A page nobody has mapped (mem_map count 1: just us) can be given back
+ * whenever get_free_page() runs out, oldest first. The descriptors are
+ * never freed, as we sleep while holding on to them.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/system.h>
+
+struct cached_page {
+	unsigned long p_page;		/* physical address, 0 = free */
+	unsigned long p_offset;		/* in the file */
+	unsigned short p_dev;
+	unsigned short p_ino;
+	unsigned char p_lock;		/* being read in */
+	unsigned char p_uptodate;
+	struct task_struct * p_wait;
+	struct cached_page * p_prev;	/* hash queue */
+	struct cached_page * p_next;	/* hash queue, or free list */
+	struct cached_page * p_prev_lru;
+	struct cached_page * p_next_lru;
+};
+
+#define PAGE_HASH_BITS	10
+#define NR_PAGE_HASH	(1<<PAGE_HASH_BITS)
+#define _hashfn(dev,ino,offset) \
+	(((((unsigned long)(ino)<<12) ^ ((unsigned long)(dev)<<24) ^ \
+	((offset)>>10)) * 0x9E3779B1UL) >> (32-PAGE_HASH_BITS))
+#define hash(dev,ino,offset) page_hash[_hashfn(dev,ino,offset)]
+
+static struct cached_page * page_hash[NR_PAGE_HASH] = {NULL, };
+static struct cached_page * free_cached = NULL;
+static struct cached_page * lru_cached = NULL;	/* oldest first */
+static int nr_cached = 0;
+static int nr_page_lookups = 0;
+static int nr_page_hits = 0;
+
+static inline void wait_on_buffer(struct buffer_head * bh)
+{
+	cli();
+	while (bh->b_lock)
+		sleep_on(&bh->b_wait);
+	sti();
+}
+
+/* pages are only locked and unlocked by processes, so no cli() here */
+static inline void wait_on_page(struct cached_page * p)
+{
+	while (p->p_lock)
+		sleep_on(&p->p_wait);
+}
+
+static struct cached_page * find_cached(int dev, int ino, unsigned long offset)
+{
+	struct cached_page * p;
+
+	for (p = hash(dev,ino,offset) ; p ; p = p->p_next)
+		if (p->p_dev == dev && p->p_ino == ino && p->p_offset == offset)
+			return p;
+	return NULL;
+}
+
+static inline void remove_from_lru(struct cached_page * p)
+{
+	if (p->p_next_lru == p)
+		lru_cached = NULL;
+	else {
+		p->p_prev_lru->p_next_lru = p->p_next_lru;
+		p->p_next_lru->p_prev_lru = p->p_prev_lru;
+		if (lru_cached == p)
+			lru_cached = p->p_next_lru;
+	}
+}
+
+static inline void insert_into_lru(struct cached_page * p)
+{
+	if (!lru_cached) {
+		lru_cached = p->p_next_lru = p->p_prev_lru = p;
+		return;
+	}
+	p->p_next_lru = lru_cached;
+	p->p_prev_lru = lru_cached->p_prev_lru;
+	lru_cached->p_prev_lru->p_next_lru = p;
+	lru_cached->p_prev_lru = p;
+}
+
+static void add_to_cache(struct cached_page * p)
+{
+	p->p_prev = NULL;
+	p->p_next = hash(p->p_dev,p->p_ino,p->p_offset);
+	hash(p->p_dev,p->p_ino,p->p_offset) = p;
+	if (p->p_next)
+		p->p_next->p_prev = p;
+	insert_into_lru(p);
+	nr_cached++;
+}
+
+/*
+ * Drops the cache's own reference to the page: if it is still mapped
+ * somewhere, it stays there.
+ */
+static void remove_from_cache(struct cached_page * p)
+{
+	if (p->p_next)
+		p->p_next->p_prev = p->p_prev;
+	if (p->p_prev)
+		p->p_prev->p_next = p->p_next;
+	else
+		hash(p->p_dev,p->p_ino,p->p_offset) = p->p_next;
+	remove_from_lru(p);
+	free_page(p->p_page);
+	p->p_page = 0;
+	p->p_dev = 0;
+	p->p_ino = 0;
+	p->p_prev = NULL;
+	p->p_next = free_cached;
+	free_cached = p;
+	nr_cached--;
+}
+
+static int get_more_cached(void)
+{
+	struct cached_page * p;
+	int i;
+
+	if (!(p = (struct cached_page *) get_free_page()))
+		return 0;
+	for (i = PAGE_SIZE/sizeof(struct cached_page) ; i-- > 0 ; p++) {
+		p->p_next = free_cached;
+		free_cached = p;
+	}
+	return 1;
+}
+
+/*
+ * fill_page() reads the blocks of a page. Blocks that are in the buffer
+ * cache are copied from there (they may be newer than the disk), the
+ * others are read straight into the page through buffer heads of our
+ * own, that never go into the buffer cache. Holes are left cleared.
+ * Returns 0 if some block couldn't be read.
+ */
+static int fill_page(struct m_inode * inode, struct cached_page * p)
+{
+	struct buffer_head tmp[PAGE_SIZE/BLOCK_SIZE];
+	struct buffer_head * bh;
+	char * addr = (char *) p->p_page;
+	int block = p->p_offset / BLOCK_SIZE;
+	int i, nr, ok = 1;
+
+	for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++,block++,addr += BLOCK_SIZE) {
+		tmp[i].b_dev = 0;
+		if (!(nr = bmap(inode,block)))
+			continue;
+		if ((bh = get_hash_table(inode->i_dev,nr)) && bh->b_uptodate) {
+			memcpy(addr,bh->b_data,BLOCK_SIZE);
+			brelse(bh);
+			continue;
+		}
+		brelse(bh);
+		tmp[i].b_data = addr;
+		tmp[i].b_blocknr = nr;
+		tmp[i].b_dev = inode->i_dev;
+		tmp[i].b_uptodate = 0;
+		tmp[i].b_dirt = 0;
+		tmp[i].b_count = 1;
+		tmp[i].b_lock = 0;
+		tmp[i].b_wait = NULL;
+		ll_rw_block(READ,tmp+i);
+	}
+	for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++)
+		if (tmp[i].b_dev) {
+			wait_on_buffer(tmp+i);
+			if (!tmp[i].b_uptodate)
+				ok = 0;
+		}
+	return ok;
+}
+
+/*
+ * cached_page() returns the page of the file at 'offset', reading it
+ * in if it isn't in the cache yet. The caller gets a reference to the
+ * page (free_page() it, or map it), or 0 if we're out of memory. If the
+ * read failed, '*ok' is cleared and the page is the caller's alone, with
+ * the bad blocks cleared. So is a copy of a page that has PAGE_MAX_SHARE
+ * users already: a shared mapping that gets one only sees what the
+ * others write once it is written back.
+ */
+static unsigned long cached_page(struct m_inode * inode, unsigned long offset,
+	int * ok)
+{
+	struct cached_page * p;
+	unsigned long page, new_page;
+
+	*ok = 1;
+	nr_page_lookups++;
+repeat:
+	if (p = find_cached(inode->i_dev,inode->i_num,offset)) {
+		wait_on_page(p);
+		if (p->p_dev != inode->i_dev || p->p_ino != inode->i_num ||
+		    p->p_offset != offset)
+			goto repeat;
+		nr_page_hits++;
+		remove_from_lru(p);
+		insert_into_lru(p);
+		page = p->p_page;
+		if (mem_map[MAP_NR(page)]++ < PAGE_MAX_SHARE)
+			return page;
+/* hold on to it while get_free_page() sleeps */
+		if (new_page = get_free_page())
+			memcpy((char *) new_page,(char *) page,PAGE_SIZE);
+		free_page(page);
+		return new_page;
+	}
+	if (!free_cached && !get_more_cached())
+		return 0;
+	if (!(page = get_free_page()))
+		return 0;
+/* we may have slept: somebody else may have read it meanwhile */
+	if (!free_cached || find_cached(inode->i_dev,inode->i_num,offset)) {
+		free_page(page);
+		goto repeat;
+	}
+	p = free_cached;
+	free_cached = p->p_next;
+	p->p_page = page;
+	p->p_dev = inode->i_dev;
+	p->p_ino = inode->i_num;
+	p->p_offset = offset;
+	p->p_lock = 1;
+	p->p_wait = NULL;
+	add_to_cache(p);
+	p->p_uptodate = fill_page(inode,p);
+	p->p_lock = 0;
+	wake_up(&p->p_wait);
+	mem_map[MAP_NR(page)]++;
+	if (!(*ok = p->p_uptodate))
+		remove_from_cache(p);
+	return page;
+}
+
+/*
+ * get_cached_page() is for demand-loading, which gets the bad blocks of
+ * a page that can't be read cleared, just like bread_page() used to do.
+ */
+unsigned long get_cached_page(struct m_inode * inode, unsigned long offset)
+{
+	int ok;
+
+	return cached_page(inode,offset,&ok);
+}
+
+/*
+ * find_cached_page() is get_cached_page() for pages that are there and
+ * read in already, and can be shared: it never reads, copies or sleeps,
+ * and returns 0 for the rest.
+ */
+unsigned long find_cached_page(struct m_inode * inode, unsigned long offset)
+{
+	struct cached_page * p;
+
+	p = find_cached(inode->i_dev,inode->i_num,offset);
+	if (!p || p->p_lock || !p->p_uptodate ||
+	    mem_map[MAP_NR(p->p_page)] >= PAGE_MAX_SHARE)
+		return 0;
+	remove_from_lru(p);
+	insert_into_lru(p);
+	mem_map[MAP_NR(p->p_page)]++;
+	return p->p_page;
+}
+
+/*
+ * page_read_ahead() is called by do_no_page() for a fault at 'offset' of
+ * a file, and starts reading the pages after it into the buffer cache.
+ * That's READA: nobody waits for it, and fill_page() copies the blocks
+ * from there when the pages are faulted in. Each inode has its own
+ * window: a fault inside the window of the last one means the program
+ * walks through the file and the window doubles, anything else halves it.
+ */
+#define RA_MIN	1
+#define RA_MAX	32
+
+void page_read_ahead(struct m_inode * inode, unsigned long offset)
+{
+	unsigned long pos;
+	int pages, i, nr;
+
+	pages = inode->i_ra_pages;
+	if (offset > inode->i_ra_offset &&
+	    offset <= inode->i_ra_offset + (pages+1)*PAGE_SIZE)
+		pages <<= 1;
+	else
+		pages >>= 1;
+	if (pages < RA_MIN)
+		pages = RA_MIN;
+	if (pages > RA_MAX)
+		pages = RA_MAX;
+	inode->i_ra_offset = offset;
+	inode->i_ra_pages = pages;
+	while (pages-- > 0) {
+		offset += PAGE_SIZE;
+		if (offset >= inode->i_size)
+			return;
+		if (find_cached(inode->i_dev,inode->i_num,offset))
+			continue;
+		for (i=0,pos=offset ; i<PAGE_SIZE/BLOCK_SIZE ; i++,pos += BLOCK_SIZE) {
+			if (pos >= inode->i_size)
+				return;
+			if (nr = bmap(inode,pos/BLOCK_SIZE))
+				bread_ahead(inode->i_dev,nr);
+		}
+	}
+}
+
+/*
+ * read_cached_page() returns the page holding byte 'pos' of the file,
+ * and where in the page it is. Pages are normally at PAGE_SIZE offsets,
+ * but if the file has been demand-loaded, use the pages that are there.
+ * Reads don't want zeroes for what couldn't be read: if there's no page,
+ * '*off' is the error instead.
+ */
+unsigned long read_cached_page(struct m_inode * inode, unsigned long pos,
+	int * off)
+{
+	unsigned long offset, tmp, page;
+	int ok;
+
+	offset = pos & 0xfffff000;
+	if (pos >= BLOCK_SIZE &&
+	    !find_cached(inode->i_dev,inode->i_num,offset)) {
+		tmp = ((pos - BLOCK_SIZE) & 0xfffff000) + BLOCK_SIZE;
+		if (find_cached(inode->i_dev,inode->i_num,tmp))
+			offset = tmp;
+	}
+	if (!(page = cached_page(inode,offset,&ok))) {
+		*off = -ENOMEM;
+		return 0;
+	}
+	if (!ok) {
+		free_page(page);
+		*off = -EIO;
+		return 0;
+	}
+	*off = pos - offset;
+	return page;
+}
+
+/*
+ * Everything that writes the blocks of a file tells us what it wrote, so
+ * that the cached pages stay the same as the buffers: file_write() and
+ * write_page() of mmap.c. (block_write() can't tell which file a block is
+ * in, and drops the cached pages of the device instead.) The data never
+ * crosses a block boundary, so it is in at most one page for each offset
+ * in a page a page may start at.
+ */
+void update_cached_pages(struct m_inode * inode, unsigned long pos,
+	char * data, int count)
+{
+	struct cached_page * p;
+	unsigned long offset;
+	int start;
+
+	if (!nr_cached)
+		return;
+	for (start = 0 ; start < PAGE_SIZE && start <= pos ; start += BLOCK_SIZE) {
+		offset = ((pos - start) & 0xfffff000) + start;
+repeat:
+		if (!(p = find_cached(inode->i_dev,inode->i_num,offset)))
+			continue;
+		if (p->p_lock) {
+			wait_on_page(p);
+			goto repeat;
+		}
+		memcpy(pos - offset + (char *) p->p_page,data,count);
+	}
+}
+
+/*
+ * Throws away the pages of an inode, or of a whole device when 'ino' is
+ * 0. Mapped pages stay where they are, they just aren't cached any more.
+ * (Removing the last page leaves 'next' pointing to itself, hence the
+ * check for an empty list.)
+ */
+static void drop_pages(int dev, int ino)
+{
+	struct cached_page * p, * next;
+	int n;
+
+repeat:
+	p = lru_cached;
+	for (n = nr_cached ; n > 0 && lru_cached ; n--,p = next) {
+		next = p->p_next_lru;
+		if (p->p_dev != dev || (ino && p->p_ino != ino))
+			continue;
+		if (p->p_lock) {
+			wait_on_page(p);
+			goto repeat;
+		}
+		remove_from_cache(p);
+	}
+}
+
+void invalidate_inode_pages(struct m_inode * inode)
+{
+	drop_pages(inode->i_dev,inode->i_num);
+}
+
+void invalidate_dev_pages(int dev)
+{
+	drop_pages(dev,0);
+}
+
+/*
+ * shrink_page_cache() is called by get_free_page() when it runs out of
+ * memory, and gives back up to 'pages' of the oldest pages that aren't
+ * mapped anywhere. It doesn't sleep.
+ */
+int shrink_page_cache(int pages)
+{
+	struct cached_page * p, * next;
+	int n, freed = 0;
+
+	p = lru_cached;
+	for (n = nr_cached ; n > 0 && lru_cached && freed < pages ; n--,p = next) {
+		next = p->p_next_lru;
+		if (p->p_lock || mem_map[MAP_NR(p->p_page)] != 1)
+			continue;
+		remove_from_cache(p);
+		freed++;
+	}
+	return freed;
+}
+
+void show_page_cache(void)
+{
+	struct cached_page * p;
+	int n, mapped = 0;
+
+	if (p = lru_cached)
+		for (n = nr_cached ; n > 0 ; n--,p = p->p_next_lru)
+			if (mem_map[MAP_NR(p->p_page)] > 1)
+				mapped++;
+	printk("Page cache: %d pages (%d mapped), %d hits/%d lookups\n\r",
+		nr_cached,mapped,nr_page_hits,nr_page_lookups);
+}
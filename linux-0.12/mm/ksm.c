@@ -0,0 +1,368 @@
+/*
+ *  linux/mm/ksm.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * ksm.c merges pages that have the same contents. fork() and share_page()
+ * only share pages between relatives: twenty unrelated processes that all
+ * build the same tables have twenty copies of them. When task 0 is idle,
+ * idle_merge_pages() goes through the page tables of the tasks a few
+ * pages at a time, hashes the anonymous pages it finds, and maps pages
+ * that turn out to be the same to one of them, write-protected. The first
+ * write gets a copy again, through do_wp_page(): for the rest of the
+ * kernel a merged page is just a shared page, like after fork().
+ *
+ * A page that has been merged is in the stable table, which keeps a
+ * reference to it. So its count never drops to 1 while it's there, and
+ * un_wp_page() always copies it: its contents can't change. A page that
+ * nothing has matched yet goes into the unstable table, with where it was
+ * seen. It may have changed since, or gone, so all that is checked again
+ * before anything is merged with it. The unstable table is emptied after
+ * each pass, and the stable table loses the pages nobody uses any more.
+ *
+ * Pages that are all zeroes simply become the zero page. A merged page
+ * isn't swapped out while it is dirty, as its count is more than 1.
+ *
+ * The kernel writes to user space after verify_area(), and may sleep in
+ * between: read() does. A 386 lets the kernel write through the write
+ * protection, straight into the merged page of everybody. A 486 can
+ * fault instead (the WP bit in cr0), and do_wp_page() makes the copy, so
+ * pages are only merged on a 486.
+ */
+
+#include <string.h>
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/head.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+#if MERGE_PAGES
+
+#define ZERO_PAGE	((unsigned long) empty_zero_page)
+
+#define FIRST_DIR	(TASK_BASE>>22)
+#define LAST_DIR	((TASK_BASE+TASK_SIZE)>>22)
+
+#define KSM_HASH	256
+#define KSM_SCAN	16		/* pages hashed each time we're idle */
+#define KSM_PAUSE	(5*HZ)		/* between two passes */
+#define KSM_MAX_SHARE	64		/* mem_map[] is a char, USED is 100 */
+
+struct ksm_item {
+	unsigned long k_page;
+	unsigned long k_hash;
+	unsigned long k_addr;		/* where an unstable page was seen */
+	unsigned short k_task;
+	unsigned short k_next;		/* in a hash chain, or free */
+};
+
+static struct ksm_item * ktable = NULL;
+static unsigned short free_kitem = 0;
+static unsigned short stable[KSM_HASH];
+static unsigned short unstable[KSM_HASH];
+static int nr_stable = 0;
+static int nr_merges = 0;
+
+static int ksm_task = 1;
+static int ksm_dir = FIRST_DIR;
+static int ksm_entry = 0;
+static unsigned long next_pass = 0;
+
+static unsigned long hash_page(unsigned long * p)
+{
+	unsigned long hash = 0;
+	int i;
+
+	for (i=0 ; i<1024 ; i++)
+		hash = ((hash << 5) | (hash >> 27)) ^ p[i];
+	return hash;
+}
+
+static inline void put_item(unsigned short nr)
+{
+	ktable[nr].k_next = free_kitem;
+	free_kitem = nr;
+}
+
+/* the page table entry of a linear address of a task, or NULL */
+static unsigned long * pte_of(struct task_struct * p, unsigned long addr)
+{
+	unsigned long dir = *PAGE_DIR_OFFSET(p,addr);
+
+	if (!(dir & 1))
+		return NULL;
+	return (unsigned long *) ((dir & 0xfffff000) + ((addr>>10) & 0xffc));
+}
+
+/*
+ * Only a page that this entry alone uses can be merged: that leaves out
+ * the page cache, the zero page, and pages that are shared already. The
+ * pages of a shared mapping are written to in place, so they stay too.
+ */
+static int mergeable(struct task_struct * p, unsigned long addr,
+	unsigned long page)
+{
+	struct vm_area_struct * vma;
+
+	if (!(page & PAGE_PRESENT))
+		return 0;
+	page &= 0xfffff000;
+	if (page < LOW_MEM || page >= HIGH_MEMORY || mem_map[MAP_NR(page)] != 1)
+		return 0;
+	vma = find_vma(p,addr - p->start_code);
+	return !vma || !(vma->vm_flags & VM_SHARED);
+}
+
+/*
+ * Maps 'to' instead of the page of 'pte'. The dirty bit stays as it was:
+ * a clean page can still be dropped and read back from its file, a dirty
+ * one can't.
+ */
+static void merge(unsigned long * pte, unsigned long to)
+{
+	unsigned long page = *pte;
+
+	*pte = to | (page & (PAGE_DIRTY | PAGE_ACCESSED)) | PAGE_USER |
+		PAGE_PRESENT;
+	if (to >= LOW_MEM)
+		mem_map[MAP_NR(to)]++;
+	invalidate();
+	free_page(page & 0xfffff000);
+	nr_merges++;
+}
+
+static void merge_page(int task_nr, unsigned long addr, unsigned long * pte)
+{
+	struct task_struct * p = task[task_nr];
+	struct ksm_item * k;
+	unsigned short * prev, nr;
+	unsigned long page, hash, * other;
+
+	if (!mergeable(p,addr,*pte))
+		return;
+	page = *pte & 0xfffff000;
+	hash = hash_page((unsigned long *) page);
+	if (!hash && !memcmp((char *) page,empty_zero_page,PAGE_SIZE)) {
+		merge(pte,ZERO_PAGE);
+		return;
+	}
+	for (prev = stable + hash % KSM_HASH ; nr = *prev ; ) {
+		k = ktable + nr;
+		if (mem_map[MAP_NR(k->k_page)] == 1) {
+			*prev = k->k_next;
+			free_page(k->k_page);
+			put_item(nr);
+			nr_stable--;
+			continue;
+		}
+		if (k->k_hash == hash && mem_map[MAP_NR(k->k_page)] < KSM_MAX_SHARE &&
+		    !memcmp((char *) k->k_page,(char *) page,PAGE_SIZE)) {
+			merge(pte,k->k_page);
+			return;
+		}
+		prev = &k->k_next;
+	}
+	for (prev = unstable + hash % KSM_HASH ; nr = *prev ;
+	    prev = &k->k_next) {
+		k = ktable + nr;
+		if (k->k_hash != hash)
+			continue;
+/* the same page again: a page table still shared since fork() */
+		if (k->k_page == page)
+			return;
+		if (!task[k->k_task] || !(other = pte_of(task[k->k_task],k->k_addr)))
+			continue;
+		if ((*other & 0xfffff000) != k->k_page ||
+		    !mergeable(task[k->k_task],k->k_addr,*other) ||
+		    memcmp((char *) k->k_page,(char *) page,PAGE_SIZE))
+			continue;
+/* it becomes a stable page: the table gets a reference of its own */
+		*prev = k->k_next;
+		*other &= ~PAGE_RW;
+		mem_map[MAP_NR(k->k_page)]++;
+		k->k_next = stable[hash % KSM_HASH];
+		stable[hash % KSM_HASH] = nr;
+		nr_stable++;
+		merge(pte,k->k_page);
+		return;
+	}
+	if (!(nr = free_kitem))
+		return;
+	k = ktable + nr;
+	free_kitem = k->k_next;
+	k->k_page = page;
+	k->k_hash = hash;
+	k->k_addr = addr;
+	k->k_task = task_nr;
+	k->k_next = unstable[hash % KSM_HASH];
+	unstable[hash % KSM_HASH] = nr;
+}
+
+/*
+ * Gives back up to 'pages' merged pages that only the stable table uses
+ * now. Called by try_to_free_pages() too: it's the cheapest memory there
+ * is. Nothing here sleeps.
+ */
+int shrink_merged_pages(int pages)
+{
+	unsigned short * prev, nr;
+	int i, freed = 0;
+
+	for (i=0 ; i<KSM_HASH && freed < pages ; i++)
+		for (prev = stable + i ; (nr = *prev) && freed < pages ; ) {
+			if (mem_map[MAP_NR(ktable[nr].k_page)] != 1) {
+				prev = &ktable[nr].k_next;
+				continue;
+			}
+			*prev = ktable[nr].k_next;
+			free_page(ktable[nr].k_page);
+			put_item(nr);
+			nr_stable--;
+			freed++;
+		}
+	return freed;
+}
+
+static void end_pass(void)
+{
+	unsigned short nr;
+	int i;
+
+	for (i=0 ; i<KSM_HASH ; i++)
+		while (nr = unstable[i]) {
+			unstable[i] = ktable[nr].k_next;
+			put_item(nr);
+		}
+	shrink_merged_pages(nr_stable);
+	next_pass = jiffies + KSM_PAUSE;
+}
+
+/*
+ * Called by task 0 when it's idle, like idle_zero_page(): hashes the next
+ * KSM_SCAN pages, and merges them where it can. Nobody else runs while
+ * we're at it, and nothing here sleeps. A whole pass over all the tasks
+ * is followed by a pause of KSM_PAUSE.
+ */
+void idle_merge_pages(void)
+{
+	struct task_struct * p;
+	unsigned long pg_table;
+	int scan = KSM_SCAN;
+
+	if (!ktable || (long) (jiffies - next_pass) < 0)
+		return;
+	for ( ; ksm_task < NR_TASKS ; ksm_task++) {
+		if (p = task[ksm_task])
+			for ( ; ksm_dir < LAST_DIR ; ksm_dir++, ksm_entry = 0) {
+				pg_table = ((unsigned long *) p->tss.cr3)[ksm_dir];
+				if (!(pg_table & 1))
+					continue;
+				pg_table &= 0xfffff000;
+				while (ksm_entry < 1024) {
+					if (!(1 & ((unsigned long *) pg_table)[ksm_entry])) {
+						ksm_entry++;
+						continue;
+					}
+					merge_page(ksm_task,(ksm_dir<<22) + (ksm_entry<<12),
+						ksm_entry + (unsigned long *) pg_table);
+					ksm_entry++;
+					if (--scan <= 0)
+						return;
+				}
+			}
+		ksm_dir = FIRST_DIR;
+		ksm_entry = 0;
+	}
+	ksm_task = 1;
+	end_pass();
+}
+
+/*
+ * A 386 can't change the AC flag. On anything newer, sets the WP bit, so
+ * that write-protection holds for the kernel too.
+ */
+static int set_wp(void)
+{
+	unsigned long flags;
+
+	__asm__("pushfl ; popl %%eax ; movl %%eax,%%ecx\n\t"
+		"xorl $0x40000,%%eax ; pushl %%eax ; popfl\n\t"
+		"pushfl ; popl %%eax ; pushl %%ecx ; popfl\n\t"
+		"xorl %%ecx,%%eax"
+		:"=a" (flags)::"cx");
+	if (!(flags & 0x40000))
+		return 0;
+	__asm__("movl %%cr0,%%eax ; orl $0x10000,%%eax ; movl %%eax,%%cr0"
+		:::"ax");
+	return 1;
+}
+
+/*
+ * One item for each page, but no more than fit in the biggest block
+ * get_free_pages() gives, and an unsigned short can number.
+ */
+#define MAX_KITEMS	((PAGE_SIZE << (NR_MEM_ORDERS-1)) / sizeof(struct ksm_item))
+
+void ksm_init(void)
+{
+	int order, i, nr;
+
+	if (!set_wp()) {
+		printk("Pages aren't merged on a 386\n\r");
+		return;
+	}
+	nr = PAGING_PAGES;
+	if (nr > MAX_KITEMS)
+		nr = MAX_KITEMS;
+	if (nr > 0xffff)
+		nr = 0xffff;
+	for (order = 0 ; (PAGE_SIZE << order) < nr*sizeof(struct ksm_item) ;
+	    order++)
+		/* nothing */ ;
+	if (!(ktable = (struct ksm_item *) get_free_pages(order))) {
+		printk("Unable to start merging pages\n\r");
+		return;
+	}
+/* item 0 isn't used: it ends the chains */
+	for (i = nr ; --i > 0 ; )
+		put_item(i);
+}
+
+void show_ksm(void)
+{
+	int i, shared = 0;
+	unsigned short nr;
+
+	if (!ktable)
+		return;
+	for (i=0 ; i<KSM_HASH ; i++)
+		for (nr = stable[i] ; nr ; nr = ktable[nr].k_next)
+			shared += mem_map[MAP_NR(ktable[nr].k_page)] - 2;
+	printk("Merged pages: %d, used %d more times, %d merges\n\r",
+		nr_stable,shared,nr_merges);
+}
+
+#else
+
+int shrink_merged_pages(int pages)
+{
+	return 0;
+}
+
+void idle_merge_pages(void)
+{
+}
+
+void ksm_init(void)
+{
+}
+
+void show_ksm(void)
+{
+}
+
+#endif
@@ -29,6 +29,7 @@
  */
 
 #include <signal.h>
+#include <string.h>
 
 #include <asm/system.h>
 
@@ -40,11 +41,211 @@
 current->start_code + current->end_code)
 
 unsigned long HIGH_MEMORY = 0;
+unsigned long nr_free_pages = 0;
+
+#define ZERO_PAGE ((unsigned long) empty_zero_page)
 
 #define copy_page(from,to) \
 __asm__("cld ; rep ; movsl"::"S" (from),"D" (to),"c" (1024):"cx","di","si")
 
-unsigned char mem_map [ PAGING_PAGES ] = {0,};
+unsigned long paging_pages = 0;
+unsigned char * mem_map = NULL;
+unsigned char * page_age = NULL;
+
+void do_no_page(unsigned long error_code,unsigned long address);
+
+/*
+ * The free pages are kept by a buddy allocator. A free block of 2^order
+ * pages starts at a page number (counted from LOW_MEM) that is a multiple
+ * of 2^order, and is on free_area[order]. Its buddy is the block it was
+ * split from, at the page number with bit 'order' flipped: when both are
+ * free they are merged again. free_order[] is the order+1 of the free
+ * block starting at a page, 0 if none does. The list links are kept in
+ * the free pages themselves.
+ *
+ * mem_map[] is still what counts the users of a page: a block only goes
+ * back on the lists when the count of its page drops to zero.
+ */
+struct free_block {
+	struct free_block * next;
+	struct free_block * prev;
+};
+
+static struct free_block * free_area[NR_MEM_ORDERS] = {NULL, };
+static int nr_free_area[NR_MEM_ORDERS] = {0, };
+static unsigned char * free_order = NULL;
+
+#define block_addr(nr) ((struct free_block *) (LOW_MEM + ((nr)<<12)))
+
+static inline void add_free(int nr, int order)
+{
+	struct free_block * b = block_addr(nr);
+
+	b->prev = NULL;
+	if (b->next = free_area[order])
+		b->next->prev = b;
+	free_area[order] = b;
+	free_order[nr] = order+1;
+	nr_free_area[order]++;
+}
+
+static inline void del_free(int nr, int order)
+{
+	struct free_block * b = block_addr(nr);
+
+	if (b->next)
+		b->next->prev = b->prev;
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		free_area[order] = b->next;
+	free_order[nr] = 0;
+	nr_free_area[order]--;
+}
+
+/* called with interrupts off */
+static void release_block(int nr, int order)
+{
+	int buddy;
+
+	while (order < NR_MEM_ORDERS-1) {
+		buddy = nr ^ (1<<order);
+		if (buddy >= PAGING_PAGES || free_order[buddy] != order+1)
+			break;
+		del_free(buddy,order);
+		nr &= ~(1<<order);
+		order++;
+	}
+	add_free(nr,order);
+}
+
+/*
+ * take_block() takes 2^order contiguous pages off the free lists, and
+ * gives each a count of 1. Call with interrupts off.
+ */
+static unsigned long take_block(int order)
+{
+	int i, nr;
+
+	for (i = order ; i < NR_MEM_ORDERS ; i++)
+		if (free_area[i])
+			break;
+	if (i >= NR_MEM_ORDERS)
+		return 0;
+	nr = MAP_NR((unsigned long) free_area[i]);
+	del_free(nr,i);
+/* split it: the upper halves go back on the lists */
+	while (i > order) {
+		i--;
+		add_free(nr + (1<<i),i);
+	}
+	for (i = 0 ; i < (1<<order) ; i++) {
+		mem_map[nr+i] = 1;
+		page_age[nr+i] = PAGE_INITIAL_AGE;
+	}
+	nr_free_pages -= 1<<order;
+	return LOW_MEM + (nr<<12);
+}
+
+#define clear_pages(addr,order) \
+__asm__("cld ; rep ; stosl"::"a" (0),"c" (1024<<(order)),"D" (addr):"cx","di")
+
+/*
+ * alloc_pages() gets 2^order contiguous pages, cleared, each with a
+ * count of 1. It doesn't try to make room: if there is no block big
+ * enough, it returns 0. See get_free_pages() for that.
+ */
+unsigned long alloc_pages(int order)
+{
+	unsigned long addr;
+
+	if (order < 0 || order >= NR_MEM_ORDERS)
+		return 0;
+	cli();
+	addr = take_block(order);
+	sti();
+	if (addr)
+		clear_pages(addr,order);
+	return addr;
+}
+
+/*
+ * Task 0 clears free pages when there is nothing else to do, and keeps
+ * up to ZERO_POOL of them here, so that page faults on anonymous memory
+ * and new page tables don't have to clear a page while somebody waits.
+ * The pages are linked through their first word. When memory gets short
+ * the pool is given back first, and it isn't refilled until there is
+ * plenty again.
+ */
+#define ZERO_POOL	32
+#define ZERO_POOL_MIN_FREE (4*ZERO_POOL)
+
+static unsigned long zeroed_pages = 0;
+static int nr_zeroed_pages = 0;
+
+/*
+ * Called by task 0 when it's idle: clears one more page for the pool, with
+ * interrupts on, so that whoever gets woken up doesn't wait long.
+ */
+void idle_zero_page(void)
+{
+	unsigned long page;
+
+	if (nr_zeroed_pages >= ZERO_POOL || nr_free_pages < ZERO_POOL_MIN_FREE)
+		return;
+	cli();
+	page = take_block(0);
+	sti();
+	if (!page)
+		return;
+	clear_pages(page,0);
+	cli();
+	*(unsigned long *) page = zeroed_pages;
+	zeroed_pages = page;
+	nr_zeroed_pages++;
+	sti();
+}
+
+/*
+ * get_zeroed_page() is get_free_page() for anonymous memory and page
+ * tables: it takes a page the idle task has cleared already if it can.
+ */
+unsigned long get_zeroed_page(void)
+{
+	unsigned long page;
+
+	cli();
+	if (page = zeroed_pages) {
+		zeroed_pages = *(unsigned long *) page;
+		nr_zeroed_pages--;
+	}
+	sti();
+	if (!page)
+		return get_free_page();
+	*(unsigned long *) page = 0;
+	return page;
+}
+
+/* gives up to 'pages' pages of the pool back to the free lists */
+int shrink_zeroed_pages(int pages)
+{
+	unsigned long page;
+	int freed = 0;
+
+	while (freed < pages) {
+		cli();
+		if (page = zeroed_pages) {
+			zeroed_pages = *(unsigned long *) page;
+			nr_zeroed_pages--;
+		}
+		sti();
+		if (!page)
+			break;
+		free_page(page);
+		freed++;
+	}
+	return freed;
+}
 
 /*
  * Free a page of memory at physical address 'addr'. Used by
@@ -57,40 +258,77 @@ void free_page(unsigned long addr)
 		panic("trying to free nonexistent page");
 	addr -= LOW_MEM;
 	addr >>= 12;
-	if (mem_map[addr]--) return;
+	if (mem_map[addr]--) {
+		if (!mem_map[addr]) {
+			cli();
+			release_block(addr,0);
+			nr_free_pages++;
+			sti();
+		}
+		return;
+	}
 	mem_map[addr]=0;
 	panic("trying to free free page");
 }
 
 /*
- * This function frees a continuos block of page tables, as needed
- * by 'exit()'. As does copy_page_tables(), this handles only 4Mb blocks.
+ * Gives back a block from get_free_pages(). The pages are freed one by
+ * one, and merge back together on the way.
  */
-int free_page_tables(unsigned long from,unsigned long size)
+void free_pages(unsigned long addr, int order)
+{
+	int i;
+
+	for (i = 0 ; i < (1<<order) ; i++,addr += PAGE_SIZE)
+		free_page(addr);
+}
+
+/*
+ * A new page directory, with the kernel part copied from pg_dir: that is
+ * the same in every task. The user part is empty.
+ */
+unsigned long get_page_dir(void)
+{
+	unsigned long dir;
+
+	if (dir = get_zeroed_page())
+		memcpy((void *) dir,pg_dir,(TASK_BASE>>22)*sizeof(unsigned long));
+	return dir;
+}
+
+/*
+ * This function frees a continuos block of page tables of a task, as
+ * needed by 'exit()'. As does copy_page_tables(), this handles only 4Mb
+ * blocks.
+ */
+int free_page_tables(struct task_struct * p, unsigned long from,
+	unsigned long size)
 {
 	unsigned long *pg_table;
 	unsigned long * dir, nr;
 
 	if (from & 0x3fffff)
 		panic("free_page_tables called with wrong alignment");
-	if (!from)
+	if (from < TASK_BASE)
 		panic("Trying to free up swapper memory space");
 	size = (size + 0x3fffff) >> 22;
-	dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
+	dir = PAGE_DIR_OFFSET(p,from);
 	for ( ; size-->0 ; dir++) {
 		if (!(1 & *dir))
 			continue;
 		pg_table = (unsigned long *) (0xfffff000 & *dir);
-		for (nr=0 ; nr<1024 ; nr++) {
-			if (*pg_table) {
-				if (1 & *pg_table)
-					free_page(0xfffff000 & *pg_table);
-				else
-					swap_free(*pg_table >> 1);
-				*pg_table = 0;
+/* a table still shared since fork() just loses one of its users */
+		if (mem_map[MAP_NR((unsigned long) pg_table)] == 1)
+			for (nr=0 ; nr<1024 ; nr++) {
+				if (*pg_table) {
+					if (1 & *pg_table)
+						free_page(0xfffff000 & *pg_table);
+					else
+						swap_free(*pg_table >> 1);
+					*pg_table = 0;
+				}
+				pg_table++;
 			}
-			pg_table++;
-		}
 		free_page(0xfffff000 & *dir);
 		*dir = 0;
 	}
@@ -100,7 +338,8 @@ int free_page_tables(unsigned long from,unsigned long size)
 
 /*
  *  Well, here is one of the most complicated functions in mm. It
- * copies a range of linerar addresses by copying only the pages.
+ * copies a range of linerar addresses of the current task to the
+ * page directory of task 'p' by copying only the pages.
  * Let's hope this is bug-free, 'cause this one I don't want to debug :-)
  *
  * Note! We don't copy just any chunks of memory - addresses have to
@@ -114,8 +353,15 @@ int free_page_tables(unsigned long from,unsigned long size)
  * doesn't take any more memory - we don't copy-on-write in the low
  * 1 Mb-range, so the pages can be shared with the kernel. Thus the
  * special case for nr=xxxx.
+ *
+ * NOTE 3!! Other page tables aren't copied at all: parent and child
+ * share them, with the page-directory entries write-protected, and
+ * whoever changes a table first gets a copy of it (un_wp_table()). Most
+ * children exec() right away, so fork() mustn't be slower for big
+ * processes.
  */
-int copy_page_tables(unsigned long from,unsigned long to,long size)
+int copy_page_tables(struct task_struct * p, unsigned long from,
+	unsigned long to, unsigned long size)
 {
 	unsigned long * from_page_table;
 	unsigned long * to_page_table;
@@ -126,16 +372,22 @@ int copy_page_tables(unsigned long from,unsigned long to,long size)
 
 	if ((from&0x3fffff) || (to&0x3fffff))
 		panic("copy_page_tables called with wrong alignment");
-	from_dir = (unsigned long *) ((from>>20) & 0xffc); /* _pg_dir = 0 */
-	to_dir = (unsigned long *) ((to>>20) & 0xffc);
-	size = ((unsigned) (size+0x3fffff)) >> 22;
+	from_dir = PAGE_DIR_OFFSET(current,from);
+	to_dir = PAGE_DIR_OFFSET(p,to);
+	size = (size+0x3fffff) >> 22;
 	for( ; size-->0 ; from_dir++,to_dir++) {
 		if (1 & *to_dir)
 			panic("copy_page_tables: already exist");
 		if (!(1 & *from_dir))
 			continue;
+		if (from) {
+			*from_dir &= ~2;
+			*to_dir = *from_dir;
+			mem_map[MAP_NR(0xfffff000 & *from_dir)]++;
+			continue;
+		}
 		from_page_table = (unsigned long *) (0xfffff000 & *from_dir);
-		if (!(to_page_table = (unsigned long *) get_free_page()))
+		if (!(to_page_table = (unsigned long *) get_zeroed_page()))
 			return -1;	/* Out of memory, see freeing */
 		*to_dir = ((unsigned long) to_page_table) | 7;
 		nr = (from==0)?0xA0:1024;
@@ -175,17 +427,17 @@ static unsigned long put_page(unsigned long page,unsigned long address)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */
-
 	if (page < LOW_MEM || page >= HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n",page,address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
-	if ((*page_table)&1)
+	page_table = PAGE_DIR_OFFSET(current,address);
+	if ((*page_table)&1) {
+		if (!((*page_table)&2))
+			un_wp_table(page_table);
 		page_table = (unsigned long *) (0xfffff000 & *page_table);
-	else {
-		if (!(tmp=get_free_page()))
+	} else {
+		if (!(tmp=get_zeroed_page()))
 			return 0;
 		*page_table = tmp | 7;
 		page_table = (unsigned long *) tmp;
@@ -205,17 +457,17 @@ unsigned long put_dirty_page(unsigned long page, unsigned long address)
 {
 	unsigned long tmp, *page_table;
 
-/* NOTE !!! This uses the fact that _pg_dir=0 */
-
 	if (page < LOW_MEM || page >= HIGH_MEMORY)
 		printk("Trying to put page %p at %p\n",page,address);
 	if (mem_map[(page-LOW_MEM)>>12] != 1)
 		printk("mem_map disagrees with %p at %p\n",page,address);
-	page_table = (unsigned long *) ((address>>20) & 0xffc);
-	if ((*page_table)&1)
+	page_table = PAGE_DIR_OFFSET(current,address);
+	if ((*page_table)&1) {
+		if (!((*page_table)&2))
+			un_wp_table(page_table);
 		page_table = (unsigned long *) (0xfffff000 & *page_table);
-	else {
-		if (!(tmp=get_free_page()))
+	} else {
+		if (!(tmp=get_zeroed_page()))
 			return 0;
 		*page_table = tmp|7;
 		page_table = (unsigned long *) tmp;
@@ -225,6 +477,33 @@ unsigned long put_dirty_page(unsigned long page, unsigned long address)
 	return page;
 }
 
+/*
+ * put_shared_page() maps a page from the page cache, or the zero page. The
+ * page has other users, so it normally goes in write-protected: a write
+ * gets a private copy. Only writable shared mappings (mmap) write to it
+ * directly.
+ */
+static unsigned long put_shared_page(unsigned long page,unsigned long address,
+	int rw)
+{
+	unsigned long tmp, *page_table;
+
+	page_table = PAGE_DIR_OFFSET(current,address);
+	if ((*page_table)&1) {
+		if (!((*page_table)&2))
+			un_wp_table(page_table);
+		page_table = (unsigned long *) (0xfffff000 & *page_table);
+	} else {
+		if (!(tmp=get_zeroed_page()))
+			return 0;
+		*page_table = tmp | 7;
+		page_table = (unsigned long *) tmp;
+	}
+	page_table[(address>>12) & 0x3ff] = page | (rw ? 7 : 5);
+/* no need for invalidate */
+	return page;
+}
+
 void un_wp_page(unsigned long * table_entry)
 {
 	unsigned long old_page,new_page;
@@ -235,15 +514,116 @@ void un_wp_page(unsigned long * table_entry)
 		invalidate();
 		return;
 	}
-	if (!(new_page=get_free_page()))
+	if (old_page == ZERO_PAGE)
+		new_page = get_zeroed_page();
+	else
+		new_page = get_free_page();
+	if (!new_page)
 		oom();
 	if (old_page >= LOW_MEM)
 		mem_map[MAP_NR(old_page)]--;
-	copy_page(old_page,new_page);
+/* new pages come cleared already */
+	if (old_page != ZERO_PAGE)
+		copy_page(old_page,new_page);
 	*table_entry = new_page | 7;
 	invalidate();
 }	
 
+/*
+ * un_wp_table() is un_wp_page() for page tables still shared since fork:
+ * the task that wants to change one gets a copy of its own, with all the
+ * pages in it write-protected on both sides, like fork() used to do.
+ * Swapped-out pages stay where they are: both tables have the entry, and
+ * the slot gets another user. A page that has PAGE_MAX_SHARE users
+ * already gets copied instead, into one of the 'spare' pages, which are
+ * linked through their first word. Only getting the new table and the
+ * spares may sleep, and then the old table may have become ours, or look
+ * different, meanwhile: hence the repeat.
+ */
+void un_wp_table(unsigned long * dir_entry)
+{
+	unsigned long * old_table, * new_table = NULL;
+	unsigned long page, spare = 0, tmp;
+	int nr, need, have = 0;
+
+repeat:
+	old_table = (unsigned long *) (0xfffff000 & *dir_entry);
+	if (mem_map[MAP_NR((unsigned long) old_table)] == 1) {
+		*dir_entry |= 2;
+		invalidate();
+		free_page((unsigned long) new_table);
+		goto free_spares;
+	}
+	if (!new_table) {
+		if (!(new_table = (unsigned long *) get_zeroed_page()))
+			oom();
+		goto repeat;
+	}
+	for (need=0,nr=0 ; nr<1024 ; nr++)
+		if ((1 & (page = old_table[nr])) && page >= LOW_MEM &&
+		    mem_map[MAP_NR(page & 0xfffff000)] >= PAGE_MAX_SHARE)
+			need++;
+	if (have < need) {
+		if (!(tmp = get_free_page()))
+			oom();
+		*(unsigned long *) tmp = spare;
+		spare = tmp;
+		have++;
+		goto repeat;
+	}
+	for (nr=0 ; nr<1024 ; nr++) {
+		if (!(page = old_table[nr]))
+			continue;
+		if (!(1 & page)) {
+			swap_duplicate(page >> 1);
+			new_table[nr] = page;
+			continue;
+		}
+/* the spares only run out for a page that is in the table twice */
+		if (spare && page >= LOW_MEM &&
+		    mem_map[MAP_NR(page & 0xfffff000)] >= PAGE_MAX_SHARE) {
+			tmp = spare;
+			spare = *(unsigned long *) tmp;
+			have--;
+			copy_page(page & 0xfffff000,tmp);
+			new_table[nr] = tmp | (page & 0xfff);
+			continue;
+		}
+		page &= ~2;
+		old_table[nr] = new_table[nr] = page;
+		if (page >= LOW_MEM)
+			mem_map[MAP_NR(page)]++;
+	}
+	*dir_entry = (unsigned long) new_table | 7;
+	free_page((unsigned long) old_table);
+	invalidate();
+free_spares:
+	while (tmp = spare) {
+		spare = *(unsigned long *) tmp;
+		free_page(tmp);
+	}
+}
+
+/*
+ * Writes to a shared mapping go to the page itself, not to a copy, and
+ * areas mapped without PROT_WRITE can't be written at all.
+ */
+static void wp_page(unsigned long * table_entry, unsigned long address)
+{
+	struct vm_area_struct * vma;
+
+	if (vma = find_vma(current,address - current->start_code)) {
+		if (!(vma->vm_flags & VM_WRITE))
+			do_exit(SIGSEGV);
+		if (vma->vm_flags & VM_SHARED) {
+			*table_entry |= 2;
+			invalidate();
+			return;
+		}
+	}
+	un_wp_page(table_entry);
+}
+
 /*
  * This routine handles present pages, when users try to write
  * to a shared page. It is done by copying the page to a new address
@@ -253,7 +633,9 @@ void un_wp_page(unsigned long * table_entry)
  */
 void do_wp_page(unsigned long error_code,unsigned long address)
 {
-	if (address < TASK_SIZE)
+	unsigned long * dir, * pte;
+
+	if (address < TASK_BASE)
 		printk("\n\rBAD! KERNEL MEMORY WP-ERR!\n\r");
 	if (address - current->start_code > TASK_SIZE) {
 		printk("Bad things happen: page error in do_wp_page\n\r");
@@ -265,22 +647,40 @@ void do_wp_page(unsigned long error_code,unsigned long address)
 	if (CODE_SPACE(address))
 		do_exit(SIGSEGV);
 #endif
-	un_wp_page((unsigned long *)
-		(((address>>10) & 0xffc) + (0xfffff000 &
-		*((unsigned long *) ((address>>20) &0xffc)))));
+	dir = PAGE_DIR_OFFSET(current,address);
+	if (!(*dir & 2))
+		un_wp_table(dir);
+	pte = (unsigned long *) (((address>>10) & 0xffc) + (0xfffff000 & *dir));
+/* un_wp_table() may have slept: the page may be writable, or gone, now */
+	if ((3 & *pte) == 1)
+		wp_page(pte,address);
 
 }
 
+/*
+ * The kernel ignores write-protection when it writes to user space, so
+ * write_verify() does the copy-on-write by hand. Missing pages are
+ * brought in first: they may well be read-only pages of the page cache,
+ * which we mustn't scribble on.
+ */
 void write_verify(unsigned long address)
 {
 	unsigned long page;
 
-	if (!( (page = *((unsigned long *) ((address>>20) & 0xffc)) )&1))
+	if (!( (page = *PAGE_DIR_OFFSET(current,address) )&1) ||
+	    !(1 & *(unsigned long *) ((page & 0xfffff000) +
+	    ((address>>10) & 0xffc))))
+		do_no_page(2,address);
+	if (!( (page = *PAGE_DIR_OFFSET(current,address) )&1))
 		return;
+	if (!(page & 2)) {
+		un_wp_table(PAGE_DIR_OFFSET(current,address));
+		page = *PAGE_DIR_OFFSET(current,address);
+	}
 	page &= 0xfffff000;
 	page += ((address>>10) & 0xffc);
 	if ((3 & *(unsigned long *) page) == 1)  /* non-writeable, present */
-		un_wp_page((unsigned long *) page);
+		wp_page((unsigned long *) page,address);
 	return;
 }
 
@@ -288,111 +688,77 @@ void get_empty_page(unsigned long address)
 {
 	unsigned long tmp;
 
-	if (!(tmp=get_free_page()) || !put_page(tmp,address)) {
+	if (!(tmp=get_zeroed_page()) || !put_page(tmp,address)) {
 		free_page(tmp);		/* 0 is ok - ignored */
 		oom();
 	}
 }
 
 /*
- * try_to_share() checks the page at address "address" in the task "p",
- * to see if it exists, and if it is clean. If so, share it with the current
- * task.
- *
- * NOTE! This assumes we have checked that p != current, and that they
- * share the same executable or library.
+ * The first touch of anonymous memory (bss, heap, stack). A read maps the
+ * zero page, write-protected: only the first write gets a page of its
+ * own, through do_wp_page().
  */
-static int try_to_share(unsigned long address, struct task_struct * p)
+static void get_anonymous_page(unsigned long error_code,
+	unsigned long address)
 {
-	unsigned long from;
-	unsigned long to;
-	unsigned long from_page;
-	unsigned long to_page;
-	unsigned long phys_addr;
-
-	from_page = to_page = ((address>>20) & 0xffc);
-	from_page += ((p->start_code>>20) & 0xffc);
-	to_page += ((current->start_code>>20) & 0xffc);
-/* is there a page-directory at from? */
-	from = *(unsigned long *) from_page;
-	if (!(from & 1))
-		return 0;
-	from &= 0xfffff000;
-	from_page = from + ((address>>10) & 0xffc);
-	phys_addr = *(unsigned long *) from_page;
-/* is the page clean and present? */
-	if ((phys_addr & 0x41) != 0x01)
-		return 0;
-	phys_addr &= 0xfffff000;
-	if (phys_addr >= HIGH_MEMORY || phys_addr < LOW_MEM)
-		return 0;
-	to = *(unsigned long *) to_page;
-	if (!(to & 1))
-		if (to = get_free_page())
-			*(unsigned long *) to_page = to | 7;
-		else
-			oom();
-	to &= 0xfffff000;
-	to_page = to + ((address>>10) & 0xffc);
-	if (1 & *(unsigned long *) to_page)
-		panic("try_to_share: to_page already exists");
-/* share them: write-protect */
-	*(unsigned long *) from_page &= ~2;
-	*(unsigned long *) to_page = *(unsigned long *) from_page;
-	invalidate();
-	phys_addr -= LOW_MEM;
-	phys_addr >>= 12;
-	mem_map[phys_addr]++;
-	return 1;
+	if (!(error_code & 2) && put_shared_page(ZERO_PAGE,address,0))
+		return;
+	get_empty_page(address);
 }
 
 /*
- * share_page() tries to find a process that could share a page with
- * the current one. Address is the address of the wanted page relative
- * to the current data space.
- *
- * We first check if it is at all feasible by checking executable->i_count.
- * It should be >1 if there are other tasks sharing this inode.
+ * Fault-around: after a fault on a page of a file, the pages around it
+ * that are in the page cache already are mapped too (write-protected,
+ * like any cached page), so that touching them doesn't fault. 'offset'
+ * is where 'address' is in the file, and only whole pages between 'start'
+ * and 'end' (relative to the task: the area that is mapped from the file)
+ * are done. The window stays within one page table, which do_no_page()
+ * has just made ours, and nothing here sleeps.
  */
-static int share_page(struct m_inode * inode, unsigned long address)
+#define FAULT_AROUND	16
+
+static void map_around(struct m_inode * inode, unsigned long address,
+	unsigned long offset, unsigned long start, unsigned long end)
 {
-	struct task_struct ** p;
+	unsigned long * table, addr, tmp, page;
+	int i;
 
-	if (inode->i_count < 2 || !inode)
-		return 0;
-	for (p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-		if (!*p)
+	if ((3 & (tmp = *PAGE_DIR_OFFSET(current,address))) != 3)
+		return;
+	table = (unsigned long *) (tmp & 0xfffff000);
+	addr = address & ~(FAULT_AROUND*PAGE_SIZE-1);
+	for (i=0 ; i<FAULT_AROUND ; i++,addr += PAGE_SIZE) {
+		tmp = addr - current->start_code;
+		if (addr == address || tmp < start || tmp + PAGE_SIZE > end)
 			continue;
-		if (current == *p)
+		if (table[(addr>>12) & 0x3ff])
 			continue;
-		if (address < LIBRARY_OFFSET) {
-			if (inode != (*p)->executable)
-				continue;
-		} else {
-			if (inode != (*p)->library)
-				continue;
-		}
-		if (try_to_share(address,*p))
-			return 1;
+		if (!(page = find_cached_page(inode,offset + addr - address)))
+			continue;
+		table[(addr>>12) & 0x3ff] = page | 5;
 	}
-	return 0;
 }
 
 void do_no_page(unsigned long error_code,unsigned long address)
 {
-	int nr[4];
-	unsigned long tmp;
-	unsigned long page;
+	unsigned long tmp, start, end, offset;
+	unsigned long page, new_page;
 	int block,i;
 	struct m_inode * inode;
+	struct vm_area_struct * vma;
 
-	if (address < TASK_SIZE)
+	if (address < TASK_BASE)
 		printk("\n\rBAD!! KERNEL PAGE MISSING\n\r");
 	if (address - current->start_code > TASK_SIZE) {
 		printk("Bad things happen: nonexistent page error in do_no_page\n\r");
 		do_exit(SIGSEGV);
 	}
-	page = *(unsigned long *) ((address >> 20) & 0xffc);
+	page = *PAGE_DIR_OFFSET(current,address);
+	if ((page & 3) == 1) {
+		un_wp_table(PAGE_DIR_OFFSET(current,address));
+		page = *PAGE_DIR_OFFSET(current,address);
+	}
 	if (page & 1) {
 		page &= 0xfffff000;
 		page += (address >> 10) & 0xffc;
@@ -404,31 +770,67 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	}
 	address &= 0xfffff000;
 	tmp = address - current->start_code;
+	if (vma = find_vma(current,tmp)) {
+		if (!(vma->vm_flags & VM_READ))
+			do_exit(SIGSEGV);
+		if (!vma->vm_inode) {
+			get_anonymous_page(error_code,address);
+			return;
+		}
+		offset = tmp - vma->vm_start + vma->vm_offset;
+		if (!(page = get_cached_page(vma->vm_inode,offset)))
+			oom();
+		if (!put_shared_page(page,address,(vma->vm_flags &
+		    (VM_SHARED | VM_WRITE)) == (VM_SHARED | VM_WRITE))) {
+			free_page(page);
+			oom();
+		}
+		map_around(vma->vm_inode,address,offset,vma->vm_start,vma->vm_end);
+		page_read_ahead(vma->vm_inode,offset);
+		return;
+	}
 	if (tmp >= LIBRARY_OFFSET ) {
 		inode = current->library;
 		block = 1 + (tmp-LIBRARY_OFFSET) / BLOCK_SIZE;
+		start = LIBRARY_OFFSET;
+		end = TASK_SIZE;
 	} else if (tmp < current->end_data) {
 		inode = current->executable;
 		block = 1 + tmp / BLOCK_SIZE;
+		start = 0;
+		end = current->end_data;
 	} else {
 		inode = NULL;
 		block = 0;
 	}
 	if (!inode) {
-		get_empty_page(address);
+		get_anonymous_page(error_code,address);
 		return;
 	}
-	if (share_page(inode,tmp))
-		return;
-	if (!(page = get_free_page()))
-		oom();
 /* remember that 1 block is used for header */
-	for (i=0 ; i<4 ; block++,i++)
-		nr[i] = bmap(inode,block);
-	bread_page(page,inode->i_dev,nr);
+	if (!(page = get_cached_page(inode,block*BLOCK_SIZE)))
+		oom();
 	i = tmp + 4096 - current->end_data;
 	if (i>4095)
 		i = 0;
+	if (i <= 0) {
+		if (!put_shared_page(page,address,0)) {
+			free_page(page);
+			oom();
+		}
+/* only whole pages of the file are shared: 'end' keeps out the bss page */
+		map_around(inode,address,block*BLOCK_SIZE,start,end);
+		page_read_ahead(inode,block*BLOCK_SIZE);
+		return;
+	}
+/* the page with the end of the data gets the bss cleared: it's ours */
+	if (!(new_page = get_free_page())) {
+		free_page(page);
+		oom();
+	}
+	copy_page(page,new_page);
+	free_page(page);
+	page = new_page;
 	tmp = page + 4096;
 	while (i-- > 0) {
 		tmp--;
@@ -440,25 +842,55 @@ void do_no_page(unsigned long error_code,unsigned long address)
 	oom();
 }
 
-void mem_init(long start_mem, long end_mem)
+/*
+ * head.s has mapped the first 16Mb: mem_init() makes the page tables for
+ * the rest, and puts mem_map[], free_order[] and page_age[] after them,
+ * as their size depends on how much memory there is. It returns where
+ * the free memory starts now.
+ */
+long mem_init(long start_mem, long end_mem)
 {
+	unsigned long addr, * table;
 	int i;
 
 	HIGH_MEMORY = end_mem;
+	for (addr = 16*1024*1024 ; addr < end_mem ; addr += PAGE_SIZE) {
+		if (!(addr & 0x3fffff)) {
+			table = (unsigned long *) start_mem;
+			start_mem += PAGE_SIZE;
+			memset(table,0,PAGE_SIZE);
+			pg_dir[addr>>22] = (unsigned long) table | 7;
+		}
+		table[(addr>>12) & 0x3ff] = addr | 7;
+	}
+	invalidate();
+	paging_pages = (end_mem - LOW_MEM) >> 12;
+	mem_map = (unsigned char *) start_mem;
+	start_mem += PAGING_PAGES;
+	free_order = (unsigned char *) start_mem;
+	start_mem += PAGING_PAGES;
+	memset(free_order,0,PAGING_PAGES);
+	page_age = (unsigned char *) start_mem;
+	start_mem += PAGING_PAGES;
+	start_mem = PAGE_ALIGN(start_mem);
 	for (i=0 ; i<PAGING_PAGES ; i++)
 		mem_map[i] = USED;
 	i = MAP_NR(start_mem);
 	end_mem -= start_mem;
 	end_mem >>= 12;
-	while (end_mem-->0)
-		mem_map[i++]=0;
+	nr_free_pages = end_mem;
+	while (end_mem-->0) {
+		mem_map[i]=0;
+		release_block(i++,0);
+	}
+	return start_mem;
 }
 
 void show_mem(void)
 {
-	int i,j,k,free=0,total=0;
+	int i,j,k,n,free=0,total=0;
 	int shared=0;
-	unsigned long * pg_tbl;
+	unsigned long * pg_tbl, * dir;
 
 	printk("Mem-info:\n\r");
 	for(i=0 ; i<PAGING_PAGES ; i++) {
@@ -470,33 +902,42 @@ void show_mem(void)
 		else
 			shared += mem_map[i]-1;
 	}
-	printk("%d free pages of %d\n\r",free,total);
+	printk("%d free pages of %d, %d of them cleared\n\r",
+		free+nr_zeroed_pages,total,nr_zeroed_pages);
+	printk("Free blocks:");
+	for (i=0 ; i<NR_MEM_ORDERS ; i++)
+		printk(" %d*%dk",nr_free_area[i],4<<i);
+	printk("\n\r");
 	printk("%d pages shared\n\r",shared);
-	k = 0;
-	for(i=4 ; i<1024 ;) {
-		if (1&pg_dir[i]) {
-			if (pg_dir[i]>HIGH_MEMORY) {
+	for (n=1 ; n<NR_TASKS ; n++) {
+		if (!task[n])
+			continue;
+		dir = (unsigned long *) task[n]->tss.cr3;
+		k = 2;		/* the task_struct and the page directory */
+		for (i=TASK_BASE>>22 ; i<1024 ; i++) {
+			if (!(1&dir[i]))
+				continue;
+			if (dir[i]>HIGH_MEMORY) {
 				printk("page directory[%d]: %08X\n\r",
-					i,pg_dir[i]);
+					i,dir[i]);
 				continue;
 			}
-			if (pg_dir[i]>LOW_MEM)
-				free++,k++;
-			pg_tbl=(unsigned long *) (0xfffff000 & pg_dir[i]);
+			k++;
+			pg_tbl=(unsigned long *) (0xfffff000 & dir[i]);
 			for(j=0 ; j<1024 ; j++)
 				if ((pg_tbl[j]&1) && pg_tbl[j]>LOW_MEM)
 					if (pg_tbl[j]>HIGH_MEMORY)
 						printk("page_dir[%d][%d]: %08X\n\r",
 							i,j, pg_tbl[j]);
 					else
-						k++,free++;
-		}
-		i++;
-		if (!(i&15) && k) {
-			k++,free++;	/* one page/process for task_struct */
-			printk("Process %d: %d pages\n\r",(i>>4)-1,k);
-			k = 0;
+						k++;
 		}
+		free += k;
+		printk("Process %d: %d pages\n\r",n,k);
 	}
 	printk("Memory found: %d (%d)\n\r",free-shared,total);
+	show_buffers();
+	show_page_cache();
+	show_ksm();
+	show_swap();
 }
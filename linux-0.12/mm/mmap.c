@@ -0,0 +1,380 @@
+/*
+ *  linux/mm/mmap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * mmap(), munmap() and msync(). A process has a list of the areas it has
+ * mapped, sorted by address. The pages themselves are brought in by
+ * do_no_page(): pages of a file come from the page cache, and are shared
+ * with everybody else that has that part of the file mapped. Private
+ * mappings get their own copy on the first write (do_wp_page), shared
+ * ones write to the cached page, which is written back to the file by
+ * msync(), munmap() and exit.
+ *
+ * Addresses are relative to the start of the task, like brk. Mappings
+ * go from MMAP_BASE up, and keep MMAP_STACK bytes away from the stack.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <asm/segment.h>
+#include <asm/system.h>
+
+#define MMAP_BASE	(TASK_SIZE/4)
+#define MMAP_STACK	0x00800000
+#define MAX_MAP_COUNT	64	/* areas a task may have */
+
+/*
+ * The page table entry of a linear address, ready to be changed (the
+ * table is no longer shared with another task), or NULL if it has no
+ * table.
+ */
+static unsigned long * pte_of(unsigned long address)
+{
+	unsigned long * dir;
+
+	dir = PAGE_DIR_OFFSET(current,address);
+	if (!(*dir & 1))
+		return NULL;
+	if (!(*dir & 2))
+		un_wp_table(dir);
+	return (unsigned long *) ((*dir & 0xfffff000) + ((address>>10) & 0xffc));
+}
+
+struct vm_area_struct * find_vma(struct task_struct * p, unsigned long addr)
+{
+	struct vm_area_struct * vma;
+
+	for (vma = p->mmap ; vma ; vma = vma->vm_next)
+		if (addr < vma->vm_end)
+			return (addr >= vma->vm_start) ? vma : NULL;
+	return NULL;
+}
+
+/*
+ * write_page() writes a page of a shared mapping back to the file, through
+ * the buffer cache. It never makes the file longer: what's past the end
+ * of the file is just memory. With 'wait' set it waits for the disk too.
+ * Like file_write(), it tells the page cache about every block, as the
+ * same bytes may be cached at another offset.
+ */
+static void write_page(struct m_inode * inode, unsigned long offset,
+	unsigned long page, int wait)
+{
+	struct buffer_head * bh;
+	int i, block;
+
+	for (i=0 ; i<PAGE_SIZE/BLOCK_SIZE ; i++) {
+		if (offset >= inode->i_size)
+			return;
+		if (!(block = create_block(inode,offset/BLOCK_SIZE)))
+			return;
+		if (!(bh = getblk(inode->i_dev,block)))
+			return;
+		memcpy(bh->b_data,(char *) page,BLOCK_SIZE);
+		bh->b_uptodate = 1;
+		mark_buffer_dirty(bh);
+		if (wait)
+			ll_rw_block(WRITE,bh);
+		brelse(bh);
+		update_cached_pages(inode,offset,(char *) page,BLOCK_SIZE);
+		offset += BLOCK_SIZE;
+		page += BLOCK_SIZE;
+	}
+}
+
+/*
+ * Takes the pages of [from,to) out of the page tables. The dirty ones of
+ * a shared mapping are written back first.
+ */
+static void unmap_pages(struct vm_area_struct * vma, unsigned long from,
+	unsigned long to)
+{
+	unsigned long * pte;
+	unsigned long page, addr;
+
+	for (addr = from ; addr < to ; addr += PAGE_SIZE) {
+		if (!(pte = pte_of(current->start_code + addr))) {
+			addr |= 0x3ff000;
+			continue;
+		}
+		if (!(page = *pte))
+			continue;
+		*pte = 0;
+		invalidate();
+		if (!(page & PAGE_PRESENT)) {
+			swap_free(page>>1);
+			continue;
+		}
+		if ((vma->vm_flags & VM_SHARED) && (page & PAGE_DIRTY))
+			write_page(vma->vm_inode,
+				addr - vma->vm_start + vma->vm_offset,
+				page & 0xfffff000,0);
+		free_page(page & 0xfffff000);
+	}
+}
+
+static void free_vmas(struct vm_area_struct * vma)
+{
+	struct vm_area_struct * next;
+
+	for ( ; vma ; vma = next) {
+		next = vma->vm_next;
+		iput(vma->vm_inode);
+		free_s(vma,sizeof(struct vm_area_struct));
+	}
+}
+
+static int map_count(void)
+{
+	struct vm_area_struct * vma;
+	int n = 0;
+
+	for (vma = current->mmap ; vma ; vma = vma->vm_next)
+		n++;
+	return n;
+}
+
+/*
+ * Removes [start,end) from the mappings of the current task. An area
+ * that has a hole punched in the middle is split in two.
+ */
+static int do_munmap(unsigned long start, unsigned long end)
+{
+	struct vm_area_struct ** p, * vma, * new;
+	unsigned long from, to;
+
+	for (p = &current->mmap ; vma = *p ; ) {
+		if (vma->vm_end <= start) {
+			p = &vma->vm_next;
+			continue;
+		}
+		if (vma->vm_start >= end)
+			break;
+		from = (start > vma->vm_start) ? start : vma->vm_start;
+		to = (end < vma->vm_end) ? end : vma->vm_end;
+		if (from > vma->vm_start && to < vma->vm_end) {
+			if (map_count() >= MAX_MAP_COUNT)
+				return -ENOMEM;
+			if (!(new = malloc(sizeof(struct vm_area_struct))))
+				return -ENOMEM;
+			*new = *vma;
+			new->vm_start = to;
+			new->vm_offset += to - vma->vm_start;
+			if (new->vm_inode)
+				new->vm_inode->i_count++;
+			vma->vm_end = to;
+			vma->vm_next = new;
+		}
+		unmap_pages(vma,from,to);
+		if (from == vma->vm_start && to == vma->vm_end) {
+			*p = vma->vm_next;
+			vma->vm_next = NULL;
+			free_vmas(vma);
+			continue;
+		}
+		if (from == vma->vm_start) {
+			vma->vm_offset += to - vma->vm_start;
+			vma->vm_start = to;
+		} else
+			vma->vm_end = from;
+		p = &vma->vm_next;
+	}
+	return 0;
+}
+
+/*
+ * Finds room for 'len' bytes between MMAP_BASE and the stack, first fit.
+ */
+static unsigned long get_unmapped_area(unsigned long len)
+{
+	struct vm_area_struct * vma;
+	unsigned long addr = MMAP_BASE;
+
+	if (addr < PAGE_ALIGN(current->brk))
+		addr = PAGE_ALIGN(current->brk);
+	for (vma = current->mmap ; vma ; vma = vma->vm_next) {
+		if (vma->vm_end <= addr)
+			continue;
+		if (addr + len <= vma->vm_start)
+			break;
+		addr = vma->vm_end;
+	}
+	if (addr + len < addr || addr + len > current->start_stack - MMAP_STACK)
+		return 0;
+	return addr;
+}
+
+static int do_mmap(unsigned long addr, unsigned long len, int prot,
+	int flags, int fd, unsigned long off)
+{
+	struct vm_area_struct ** p, * vma;
+	struct m_inode * inode = NULL;
+	struct file * file;
+	int error;
+
+	if (!len || (off & ~0xfffff000) || (addr & ~0xfffff000))
+		return -EINVAL;
+	len = PAGE_ALIGN(len);
+	if (!len || off + len < off)
+		return -EINVAL;
+	switch (flags & MAP_TYPE) {
+		case MAP_SHARED:
+			if (flags & MAP_ANONYMOUS)
+				return -EINVAL;
+			break;
+		case MAP_PRIVATE:
+			break;
+		default:
+			return -EINVAL;
+	}
+	if (!(flags & MAP_ANONYMOUS)) {
+		if (fd >= NR_OPEN || fd < 0 || !(file = current->filp[fd]))
+			return -EBADF;
+		inode = file->f_inode;
+		if (!inode || !S_ISREG(inode->i_mode))
+			return -ENODEV;
+		if ((file->f_flags & O_ACCMODE) == O_WRONLY)
+			return -EACCES;
+		if ((flags & MAP_TYPE) == MAP_SHARED && (prot & PROT_WRITE) &&
+		    (file->f_flags & O_ACCMODE) != O_RDWR)
+			return -EACCES;
+	}
+	if (map_count() >= MAX_MAP_COUNT)
+		return -ENOMEM;
+	if (flags & MAP_FIXED) {
+		if (addr < PAGE_ALIGN(current->brk) || addr + len < addr ||
+		    addr + len > current->start_stack - MMAP_STACK)
+			return -EINVAL;
+		if (error = do_munmap(addr,addr+len))
+			return error;
+	} else if (!(addr = get_unmapped_area(len)))
+		return -ENOMEM;
+	if (!(vma = malloc(sizeof(struct vm_area_struct))))
+		return -ENOMEM;
+	vma->vm_start = addr;
+	vma->vm_end = addr + len;
+	vma->vm_offset = inode ? off : 0;
+	vma->vm_inode = inode;
+	vma->vm_flags = 0;
+	if (prot & (PROT_READ | PROT_EXEC | PROT_WRITE))
+		vma->vm_flags |= VM_READ;
+	if (prot & PROT_WRITE)
+		vma->vm_flags |= VM_WRITE;
+	if ((flags & MAP_TYPE) == MAP_SHARED)
+		vma->vm_flags |= VM_SHARED;
+	if (inode)
+		inode->i_count++;
+	for (p = &current->mmap ; *p && (*p)->vm_start < addr ; p = &(*p)->vm_next)
+		/* nothing */ ;
+	vma->vm_next = *p;
+	*p = vma;
+	return addr;
+}
+
+/*
+ * mmap() has six arguments, more than fit in the registers: they are
+ * passed in a block in user space.
+ */
+int sys_mmap(unsigned long * buffer)
+{
+	unsigned long arg[6];
+	int i;
+
+/* a vfork() child mustn't change the mappings of its parent */
+	if (current->flags & PF_VFORK)
+		return -EINVAL;
+	for (i=0 ; i<6 ; i++)
+		arg[i] = get_fs_long(buffer+i);
+	return do_mmap(arg[0],arg[1],arg[2],arg[3],arg[4],arg[5]);
+}
+
+int sys_munmap(unsigned long addr, unsigned long len)
+{
+	if (current->flags & PF_VFORK)
+		return -EINVAL;
+	if ((addr & ~0xfffff000) || !len || addr + len < addr)
+		return -EINVAL;
+	return do_munmap(addr,PAGE_ALIGN(addr+len));
+}
+
+/*
+ * msync() writes the dirty pages of the shared mappings in the range
+ * back to their file. The pages stay mapped: clearing the dirty bit
+ * makes the next write set it again.
+ */
+int sys_msync(unsigned long addr, unsigned long len, int flags)
+{
+	struct vm_area_struct * vma;
+	unsigned long * pte;
+	unsigned long page, end;
+
+	if ((addr & ~0xfffff000) || addr + len < addr)
+		return -EINVAL;
+	end = PAGE_ALIGN(addr+len);
+	for ( ; addr < end ; addr += PAGE_SIZE) {
+		if (!(vma = find_vma(current,addr)))
+			return -ENOMEM;
+		if (!(vma->vm_flags & VM_SHARED))
+			continue;
+		if (!(pte = pte_of(current->start_code + addr)))
+			continue;
+		page = *pte;
+		if ((page & (PAGE_PRESENT | PAGE_DIRTY)) !=
+		    (PAGE_PRESENT | PAGE_DIRTY))
+			continue;
+		*pte &= ~PAGE_DIRTY;
+		invalidate();
+		page &= 0xfffff000;
+/* hold on to the page: write_page() may sleep */
+		mem_map[MAP_NR(page)]++;
+		write_page(vma->vm_inode,addr - vma->vm_start + vma->vm_offset,
+			page,flags & MS_SYNC);
+		free_page(page);
+	}
+	return 0;
+}
+
+/*
+ * fork() gives the child copies of the parent's areas: the page tables
+ * have been copied already.
+ */
+int copy_mmap(struct task_struct * p)
+{
+	struct vm_area_struct * vma, * new, ** tail;
+
+	p->mmap = NULL;
+	tail = &p->mmap;
+	for (vma = current->mmap ; vma ; vma = vma->vm_next) {
+		if (!(new = malloc(sizeof(struct vm_area_struct)))) {
+			free_vmas(p->mmap);
+			p->mmap = NULL;
+			return -ENOMEM;
+		}
+		*new = *vma;
+		new->vm_next = NULL;
+		if (new->vm_inode)
+			new->vm_inode->i_count++;
+		*tail = new;
+		tail = &new->vm_next;
+	}
+	return 0;
+}
+
+/*
+ * exit() and exec() drop all the mappings, before the page tables go.
+ */
+void exit_mmap(void)
+{
+	if (current->mmap)
+		do_munmap(0,TASK_SIZE);
+}
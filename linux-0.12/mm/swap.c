@@ -9,14 +9,18 @@
  * Started 18.12.91
  */
 
+#include <errno.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/swap.h>
 
 #include <linux/mm.h>
 #include <linux/sched.h>
 #include <linux/head.h>
 #include <linux/kernel.h>
 
-#define SWAP_BITS (4096<<3)
+/* the header page of a swap area has room for a bit-map of this many */
+#define SWAP_BITS (4086<<3)
 
 #define bitop(name,op) \
 static inline int name(char * addr,unsigned int nr) \
@@ -32,26 +36,260 @@ bitop(bit,"")
 bitop(setbit,"s")
 bitop(clrbit,"r")
 
-static char * swap_bitmap = NULL;
+/*
+ * There can be MAX_SWAPFILES swap areas, block devices or regular files,
+ * each with a bit-map (a bit set for each free slot) that is as big as
+ * it needs to be. Slot 0 is the header: its bit-map, of SWAP_BITS slots,
+ * and the signature. Beyond those, all slots are taken to be good.
+ *
+ * A swap entry, as it is kept in a page table (shifted left one, so the
+ * present bit is off), is the number of the area and the slot in it.
+ * 0 is never an entry, as slot 0 is never used. swap_map[] counts the
+ * page tables that have the entry of a slot in use: un_wp_table() copies
+ * swapped-out entries too. Each of those tables belongs to a different
+ * task, so a count never gets past NR_TASKS.
+ *
+ * The areas in use are in swap_list, highest priority first. Slots are
+ * taken from the first area of the highest priority that has any, and
+ * swap_list.next goes round the areas of that priority in turn, so the
+ * paging is spread over them.
+ */
+#define MAX_SWAPFILES	8
+#define ZSWAP_TYPE	MAX_SWAPFILES	/* compressed, in memory */
+#define SWP_TYPE(entry)	((entry) >> 24)
+#define SWP_OFFSET(entry) ((entry) & 0xffffff)
+#define SWP_ENTRY(type,offset) (((type) << 24) | (offset))
+
+/* swap_map[] has a byte a slot, and is in one get_free_pages() */
+#define MAX_SWAP_SLOTS	(PAGE_SIZE << (NR_MEM_ORDERS-1))
+
+struct swap_info_struct {
+	unsigned short flags;
+	short prio;
+	int dev;
+	struct m_inode * inode;		/* a swap file, or NULL */
+	char * bitmap;
+	unsigned char * cluster_free;	/* free slots in each clusterful */
+	unsigned char * swap_map;	/* users of each slot */
+	int order;
+	int map_order;
+	int max;			/* slots, the header's included */
+	int nr_free;
+	int hint;			/* see get_area_slots() */
+	int next;			/* in swap_list, -1 at the end */
+};
+
+#define SWP_USED	1
+#define SWP_WRITEOK	3
+
+static struct swap_info_struct swap_info[MAX_SWAPFILES];
+static struct {
+	int head;
+	int next;
+} swap_list = {-1, -1};
+static int least_priority = 0;
 int SWAP_DEV = 0;
 
 /*
- * We never page the pages in task[0] - kernel memory.
+ * We never page the kernel part of the page directories, nor task[0].
  * We page all other pages.
  */
-#define FIRST_VM_PAGE (TASK_SIZE>>12)
-#define LAST_VM_PAGE (1024*1024)
-#define VM_PAGES (LAST_VM_PAGE - FIRST_VM_PAGE)
+#define FIRST_VM_PAGE (TASK_BASE>>12)
+#define LAST_VM_PAGE ((TASK_BASE+TASK_SIZE)>>12)
+
+/*
+ * Swapping is done SWAP_CLUSTER pages at a time. swap_out() gives the
+ * pages it throws out slots next to each other, copies them into a
+ * cluster and writes that in one go. swap_in() reads the slots around
+ * the one it wants into a cluster, and the faults that follow take their
+ * pages from there: the clusters are the swap cache. c_valid has a bit
+ * for each slot whose page is in c_data. A slot loses its bit when it is
+ * freed, so nothing stale is ever found, and a slot is never valid in two
+ * clusters. Only processes use the clusters, so no cli() here.
+ */
+#define CLUSTER_ORDER	3
+#define SWAP_CLUSTER	(1<<CLUSTER_ORDER)
+#define NR_CLUSTERS	4
+
+struct swap_cluster {
+	char * c_data;			/* SWAP_CLUSTER pages */
+	int c_first;			/* slot of the first page */
+	unsigned char c_valid;
+	unsigned char c_lock;
+	struct task_struct * c_wait;
+};
+
+static struct swap_cluster cluster[NR_CLUSTERS];
+static int nr_clusters = 0;
+
+/*
+ * The slots are handed out a clusterful at a time too. A clusterful of
+ * slots is a byte of the bit-map, and cluster_free[] counts the free
+ * slots in each.
+ */
+#define CLUSTER_MASK	((1<<SWAP_CLUSTER)-1)
+
+#define in_cluster(c,nr) ((unsigned) ((nr) - (c)->c_first) < SWAP_CLUSTER && \
+	((c)->c_valid & (1 << ((nr) - (c)->c_first))))
+
+static inline void unlock_cluster(struct swap_cluster * c)
+{
+	c->c_lock = 0;
+	wake_up(&c->c_wait);
+}
 
-static int get_swap_page(void)
+/* the cluster with the page of slot 'nr', or NULL */
+static struct swap_cluster * find_cluster(int nr)
 {
-	int nr;
+	int i;
+
+	for (i = 0 ; i < nr_clusters ; i++)
+		if (in_cluster(cluster+i,nr))
+			return cluster+i;
+	return NULL;
+}
 
-	if (!swap_bitmap)
+/* an empty cluster, locked: an unlocked one if there is one */
+static struct swap_cluster * get_cluster(void)
+{
+	static int next = 0;
+	struct swap_cluster * c;
+	int i;
+
+	for (i = 0 ; i < nr_clusters ; i++) {
+		c = cluster + next;
+		if (++next >= nr_clusters)
+			next = 0;
+		if (!c->c_lock)
+			break;
+	}
+	while (c->c_lock)
+		sleep_on(&c->c_wait);
+	c->c_lock = 1;
+	c->c_valid = 0;
+	return c;
+}
+
+static inline void take_slot(struct swap_info_struct * p, int nr)
+{
+	clrbit(p->bitmap,nr);
+	p->swap_map[nr] = 1;
+	p->nr_free--;
+	p->cluster_free[nr/SWAP_CLUSTER]--;
+}
+
+/*
+ * Takes up to SWAP_CLUSTER free slots next to each other from an area.
+ * A clusterful that is all free is looked for a long word at a time,
+ * from p->hint on, the word where the last one was found. If there isn't
+ * one, the slots are taken from the clusterful with the most free, as
+ * many as are free in a row there. Returns the first of them, and how
+ * many there are in '*count'.
+ */
+static int get_area_slots(struct swap_info_struct * p, int * count)
+{
+	unsigned long * map = (unsigned long *) p->bitmap;
+	unsigned long word;
+	int i, n, nr, first, words, best;
+
+	*count = 0;
+	if (!p->nr_free)
+		return 0;
+	words = (p->max + 31) >> 5;
+	for (n = words, i = p->hint ; n-- > 0 ; i++) {
+		if (i >= words)
+			i = 0;
+		if (!(word = map[i]))
+			continue;
+		for (nr = 0 ; nr < 32 ; nr += SWAP_CLUSTER, word >>= SWAP_CLUSTER)
+			if ((word & CLUSTER_MASK) == CLUSTER_MASK) {
+				p->hint = i;
+				nr += i<<5;
+				goto found;
+			}
+	}
+	best = 0;
+	n = (p->max + SWAP_CLUSTER - 1) / SWAP_CLUSTER;
+	for (i = 1 ; i < n ; i++)
+		if (p->cluster_free[i] > p->cluster_free[best])
+			best = i;
+	for (nr = best*SWAP_CLUSTER ; !bit(p->bitmap,nr) ; nr++)
+		/* nothing */ ;
+found:
+	first = nr;
+	while (*count < SWAP_CLUSTER && nr < p->max && bit(p->bitmap,nr)) {
+		take_slot(p,nr++);
+		++*count;
+	}
+	return first;
+}
+
+/*
+ * get_swap_slots() is get_area_slots() for the best area there is, and
+ * returns a swap entry (0 if swap-space is full).
+ */
+static int get_swap_slots(int * count)
+{
+	struct swap_info_struct * p;
+	int type, offset, wrapped = 0;
+
+	*count = 0;
+	if ((type = swap_list.next) < 0)
+		return 0;
+	for (;;) {
+		p = swap_info + type;
+		if ((p->flags & SWP_WRITEOK) == SWP_WRITEOK &&
+		    (offset = get_area_slots(p,count))) {
+			if (p->next >= 0 && swap_info[p->next].prio == p->prio)
+				swap_list.next = p->next;
+			else
+				swap_list.next = swap_list.head;
+			return SWP_ENTRY(type,offset);
+		}
+		type = p->next;
+		if (!wrapped) {
+			if (type < 0 || swap_info[type].prio != p->prio) {
+				type = swap_list.head;
+				wrapped = 1;
+			}
+		} else if (type < 0)
+			return 0;
+	}
+}
+
+/* the area of a swap entry, or NULL if there is no such slot */
+static struct swap_info_struct * swap_area(int swap_nr)
+{
+	struct swap_info_struct * p;
+
+	if (SWP_TYPE(swap_nr) >= MAX_SWAPFILES)
+		return NULL;
+	p = swap_info + SWP_TYPE(swap_nr);
+	if (!(p->flags & SWP_USED) || !SWP_OFFSET(swap_nr) ||
+	    SWP_OFFSET(swap_nr) >= p->max)
+		return NULL;
+	return p;
+}
+
+/*
+ * Drops a user of a slot. The last one frees it, and drops its page from
+ * the swap cache. 1 if it was free.
+ */
+static int free_slot(int swap_nr)
+{
+	struct swap_info_struct * p = swap_info + SWP_TYPE(swap_nr);
+	struct swap_cluster * c;
+	int nr = SWP_OFFSET(swap_nr);
+
+	if (bit(p->bitmap,nr))
+		return 1;
+	if (--p->swap_map[nr])
 		return 0;
-	for (nr = 1; nr < 32768 ; nr++)
-		if (clrbit(swap_bitmap,nr))
-			return nr;
+	if (c = find_cluster(swap_nr))
+		c->c_valid &= ~(1 << (swap_nr - c->c_first));
+	setbit(p->bitmap,nr);
+	p->nr_free++;
+	p->cluster_free[nr/SWAP_CLUSTER]++;
 	return 0;
 }
 
@@ -59,58 +297,233 @@ void swap_free(int swap_nr)
 {
 	if (!swap_nr)
 		return;
-	if (swap_bitmap && swap_nr < SWAP_BITS)
-		if (!setbit(swap_bitmap,swap_nr))
+	if (SWP_TYPE(swap_nr) == ZSWAP_TYPE) {
+		zswap_free(SWP_OFFSET(swap_nr));
+		return;
+	}
+	if (swap_area(swap_nr))
+		if (!free_slot(swap_nr))
 			return;
 	printk("Swap-space bad (swap_free())\n\r");
 	return;
 }
 
-void swap_in(unsigned long *table_ptr)
+/* another page table has the entry: see un_wp_table() */
+void swap_duplicate(int swap_nr)
 {
-	int swap_nr;
-	unsigned long page;
+	struct swap_info_struct * p;
+
+	if (SWP_TYPE(swap_nr) == ZSWAP_TYPE) {
+		zswap_duplicate(SWP_OFFSET(swap_nr));
+		return;
+	}
+	if ((p = swap_area(swap_nr)) && !bit(p->bitmap,SWP_OFFSET(swap_nr))) {
+		p->swap_map[SWP_OFFSET(swap_nr)]++;
+		return;
+	}
+	printk("Swap-space bad (swap_duplicate())\n\r");
+}
+
+/*
+ * rw_swap_pages() reads or writes 'nr' pages from slot 'swap_nr' on. A
+ * swap file goes block by block, through bmap().
+ */
+void rw_swap_pages(int rw, int swap_nr, char * buffer, int nr)
+{
+	struct swap_info_struct * p = swap_info + SWP_TYPE(swap_nr);
+	int b[SWAP_CLUSTER*(PAGE_SIZE/BLOCK_SIZE)];
+	int i, n, block;
 
-	if (!swap_bitmap) {
-		printk("Trying to swap in without swap bit-map");
+	if (!swap_area(swap_nr) || SWP_OFFSET(swap_nr) + nr > p->max) {
+		printk("rw_swap_pages: bad swap entry %08x\n\r",swap_nr);
 		return;
 	}
+	if (!p->inode) {
+		ll_rw_pages(rw,p->dev,SWP_OFFSET(swap_nr),buffer,nr);
+		return;
+	}
+	block = SWP_OFFSET(swap_nr) * (PAGE_SIZE/BLOCK_SIZE);
+	while (nr > 0) {
+		n = (nr > SWAP_CLUSTER) ? SWAP_CLUSTER : nr;
+		for (i = 0 ; i < n*(PAGE_SIZE/BLOCK_SIZE) ; i++)
+			b[i] = bmap(p->inode,block++);
+		ll_rw_swap_file(rw,p->dev,b,i,buffer);
+		buffer += n*PAGE_SIZE;
+		nr -= n;
+	}
+}
+
+/*
+ * Gets the page of slot 'nr': from the swap cache if it is there, or else
+ * by reading the clusterful of slots around it into a cluster. Only the
+ * slots in use that aren't in a cluster already are valid afterwards: in
+ * a cluster that's still being written out, a page isn't on disk yet.
+ */
+static void read_swap_slot(int nr, char * page)
+{
+	struct swap_info_struct * p = swap_info + SWP_TYPE(nr);
+	struct swap_cluster * c;
+	int first, end, i;
+
+repeat:
+	if (c = find_cluster(nr)) {
+		if (c->c_lock) {
+			sleep_on(&c->c_wait);
+			goto repeat;
+		}
+		memcpy(page,c->c_data + ((nr - c->c_first)<<12),PAGE_SIZE);
+		return;
+	}
+	c = get_cluster();
+/* we may have slept: somebody else may have read it meanwhile */
+	if (find_cluster(nr)) {
+		unlock_cluster(c);
+		goto repeat;
+	}
+	first = nr & ~(SWAP_CLUSTER-1);
+	if (!SWP_OFFSET(first))
+		first++;
+	end = (nr | (SWAP_CLUSTER-1)) + 1;
+	if (SWP_OFFSET(end-1) >= p->max)
+		end = SWP_ENTRY(SWP_TYPE(nr),p->max);
+	c->c_first = first;
+	for (i = first ; i < end ; i++)
+		if (!bit(p->bitmap,SWP_OFFSET(i)) && !find_cluster(i))
+			c->c_valid |= 1 << (i - first);
+	rw_swap_pages(READ,first,c->c_data,end - first);
+	memcpy(page,c->c_data + ((nr - first)<<12),PAGE_SIZE);
+	unlock_cluster(c);
+}
+
+/*
+ * swap_in_page() brings in the page of a page table entry. Returns 0 if
+ * there was no memory for it.
+ */
+static int swap_in_page(unsigned long * table_ptr)
+{
+	int swap_nr;
+	unsigned long page;
+
 	if (1 & *table_ptr) {
 		printk("trying to swap in present page\n\r");
-		return;
+		return 1;
 	}
 	swap_nr = *table_ptr >> 1;
-	if (!swap_nr) {
+	if (SWP_TYPE(swap_nr) != ZSWAP_TYPE && !swap_area(swap_nr)) {
 		printk("No swap page in swap_in\n\r");
-		return;
+		return 1;
 	}
 	if (!(page = get_free_page()))
-		oom();
-	read_swap_page(swap_nr, (char *) page);
-	if (setbit(swap_bitmap,swap_nr))
+		return 0;
+	if (SWP_TYPE(swap_nr) == ZSWAP_TYPE) {
+/* zswap_load() frees the entry: we mustn't have slept in vain */
+		if (*table_ptr == swap_nr<<1) {
+			zswap_load(SWP_OFFSET(swap_nr),(char *) page);
+			*table_ptr = page | (PAGE_DIRTY | 7);
+		} else
+			free_page(page);
+		return 1;
+	}
+	read_swap_slot(swap_nr, (char *) page);
+/* a shared page table: the other task may have brought it in meanwhile */
+	if (*table_ptr != swap_nr<<1) {
+		free_page(page);
+		return 1;
+	}
+	if (free_slot(swap_nr))
 		printk("swapping in multiply from same page\n\r");
 	*table_ptr = page | (PAGE_DIRTY | 7);
+	return 1;
+}
+
+void swap_in(unsigned long *table_ptr)
+{
+	if (!swap_in_page(table_ptr))
+		oom();
+}
+
+/*
+ * The pages one swap_out() throws out go to the slots first..first+slots
+ * in turn, through cluster 'c', which is written when it is full.
+ */
+struct swap_batch {
+	struct swap_cluster * c;
+	int first, slots, used;
+};
+
+static void start_batch(struct swap_batch * b)
+{
+	b->c = NULL;
+	b->slots = b->used = 0;
+	if (!nr_clusters)
+		return;
+	b->c = get_cluster();
+	b->first = get_swap_slots(&b->slots);
+	b->c->c_first = b->first;
 }
 
-int try_to_swap_out(unsigned long * table_ptr)
+static void end_batch(struct swap_batch * b)
+{
+	int i;
+
+	if (!b->c)
+		return;
+	for (i = b->used ; i < b->slots ; i++)
+		free_slot(b->first + i);
+	if (b->used)
+		rw_swap_pages(WRITE,b->first,b->c->c_data,b->used);
+	unlock_cluster(b->c);
+}
+
+/*
+ * try_to_swap_out() is the clock hand going past a page: if it has been
+ * accessed since the last time, its age goes up, if not, it goes down,
+ * and only a page whose age is all gone is thrown out. A dirty one is
+ * compressed into memory if it can be, or else copied into the batch.
+ * Returns 1 if the page was freed. Doesn't sleep.
+ */
+static int try_to_swap_out(unsigned long * table_ptr, struct swap_batch * b)
 {
 	unsigned long page;
 	unsigned long swap_nr;
+	int nr, freed;
 
 	page = *table_ptr;
 	if (!(PAGE_PRESENT & page))
 		return 0;
 	if (page - LOW_MEM > PAGING_MEMORY)
 		return 0;
+	nr = MAP_NR(page & 0xfffff000);
+	if (PAGE_ACCESSED & page) {
+		*table_ptr = page & ~PAGE_ACCESSED;
+		if (page_age[nr] > PAGE_MAX_AGE - PAGE_ADVANCE)
+			page_age[nr] = PAGE_MAX_AGE;
+		else
+			page_age[nr] += PAGE_ADVANCE;
+		return 0;
+	}
+	if (page_age[nr] > PAGE_DECLINE) {
+		page_age[nr] -= PAGE_DECLINE;
+		return 0;
+	}
+	page_age[nr] = 0;
 	if (PAGE_DIRTY & page) {
 		page &= 0xfffff000;
-		if (mem_map[MAP_NR(page)] != 1)
+		if (mem_map[nr] != 1)
 			return 0;
-		if (!(swap_nr = get_swap_page()))
+		if (swap_nr = zswap_store(page,&freed)) {
+			*table_ptr = SWP_ENTRY(ZSWAP_TYPE,swap_nr)<<1;
+			invalidate();
+			return freed;
+		}
+		if (b->used >= b->slots)
 			return 0;
+		swap_nr = b->first + b->used;
+		memcpy(b->c->c_data + (b->used<<12),(char *) page,PAGE_SIZE);
+		b->c->c_valid |= 1 << b->used;
+		b->used++;
 		*table_ptr = swap_nr<<1;
 		invalidate();
-		write_swap_page(swap_nr, (char *) page);
 		free_page(page);
 		return 1;
 	}
@@ -121,133 +534,460 @@ int try_to_swap_out(unsigned long * table_ptr)
 }
 
 /*
- * Ok, this has a rather intricate logic - the idea is to make good
- * and fast machine code. If we didn't worry about that, things would
- * be easier.
+ * scan_pages() goes round the tasks, and through the user part of the
+ * page directory of each, starting where it stopped the last time, until
+ * it has freed 'pages', or looked at '*scan' pages, or the batch is full.
+ * A page has to be passed over PAGE_MAX_AGE/PAGE_DECLINE times without
+ * being used before it goes, so that's how many rounds (and a bit) it
+ * makes at most: then '*scan' is set to -1. Returns the pages freed.
  */
-int swap_out(void)
+static int swap_task = 1;
+static int dir_entry = FIRST_VM_PAGE>>10;
+static int page_entry = 0;
+
+static int scan_pages(struct swap_batch * b, int pages, int * scan)
 {
-	static int dir_entry = FIRST_VM_PAGE>>10;
-	static int page_entry = -1;
-	int counter = VM_PAGES;
-	int pg_table;
+	struct task_struct * p;
+	unsigned long pg_table;
+	int counter, freed = 0;
 
-	while (counter>0) {
-		pg_table = pg_dir[dir_entry];
-		if (pg_table & 1)
-			break;
-		counter -= 1024;
-		dir_entry++;
-		if (dir_entry >= 1024)
-			dir_entry = FIRST_VM_PAGE>>10;
-	}
-	pg_table &= 0xfffff000;
-	while (counter-- > 0) {
-		page_entry++;
-		if (page_entry >= 1024) {
-			page_entry = 0;
-		repeat:
-			dir_entry++;
-			if (dir_entry >= 1024)
-				dir_entry = FIRST_VM_PAGE>>10;
-			pg_table = pg_dir[dir_entry];
-			if (!(pg_table&1))
-				if ((counter -= 1024) > 0)
-					goto repeat;
-				else
-					break;
-			pg_table &= 0xfffff000;
-		}
-		if (try_to_swap_out(page_entry + (unsigned long *) pg_table))
-			return 1;
+	counter = (PAGE_MAX_AGE/PAGE_DECLINE + 2) * NR_TASKS;
+	for ( ; counter-- >= 0 ; ) {
+		if (p = task[swap_task])
+			for ( ; dir_entry < LAST_VM_PAGE>>10 ;
+			    dir_entry++, page_entry = 0) {
+				pg_table = ((unsigned long *) p->tss.cr3)[dir_entry];
+				if (!(pg_table & 1))
+					continue;
+				pg_table &= 0xfffff000;
+				while (page_entry < 1024) {
+					if (!(1 & ((unsigned long *) pg_table)[page_entry])) {
+						page_entry++;
+						continue;
+					}
+					if (try_to_swap_out(page_entry++ +
+					    (unsigned long *) pg_table,b))
+						freed++;
+					if (freed >= pages || --*scan <= 0 ||
+					    (b->slots && b->used >= b->slots))
+						goto out;
+				}
+			}
+		dir_entry = FIRST_VM_PAGE>>10;
+		page_entry = 0;
+		if (++swap_task >= NR_TASKS)
+			swap_task = 1;
 	}
-	printk("Out of swap-memory\n\r");
-	return 0;
+	*scan = -1;
+out:
+/* the accessed bits we cleared may still be set in the TLB */
+	invalidate();
+	return freed;
 }
 
 /*
- * Get physical address of first (actually last :-) free page, and mark it
- * used. If no free pages left, return 0.
+ * swap_out() frees up to 'pages' pages, looking at no more than 'scan',
+ * a batch at a time: the batch is written (and we sleep) between scans.
  */
-unsigned long get_free_page(void)
+static int swap_out(int pages, int scan)
+{
+	struct swap_batch b;
+	int freed = 0;
+
+	while (freed < pages && scan > 0) {
+		start_batch(&b);
+		freed += scan_pages(&b,pages - freed,&scan);
+		end_batch(&b);
+	}
+	if (!freed && scan < 0)
+		printk("Out of swap-memory\n\r");
+	return freed;
+}
+
+/*
+ * try_to_free_pages() gives back up to 'pages' pages, the cheap ones
+ * first: clean buffers and cached pages cost less to get back than
+ * swapping something out. 'scan' is how hard swap_out() tries.
+ */
+static int try_to_free_pages(int pages, int scan)
 {
-register unsigned long __res asm("ax");
+	int freed;
+
+	freed = shrink_zeroed_pages(pages);
+	if (freed < pages)
+		freed += shrink_merged_pages(pages - freed);
+	if (freed < pages)
+		freed += shrink_buffers(pages - freed);
+	if (freed < pages)
+		freed += shrink_page_cache(pages - freed);
+	if (freed < pages)
+		freed += swap_out(pages - freed,scan);
+	return freed;
+}
+
+/*
+ * Get the physical address of 2^order free, cleared and contiguous pages,
+ * and mark them used.
+ *
+ * Memory is kept between FREE_PAGES_LOW and FREE_PAGES_HIGH free pages:
+ * once it drops below the low mark, whoever asks for a page first frees
+ * enough to get back to the high one, looking at SWAP_SCAN pages for each
+ * page it is short of. So the further down we are, the faster the clock
+ * goes round. Only if there really is nothing free does swap_out() have
+ * to go all the way. Freeing pages doesn't mean they are next to each
+ * other, though, so bigger blocks give up after a while: returns 0 if it
+ * didn't work out.
+ */
+#define FREE_PAGES_LOW	(PAGING_PAGES/64 + 8)
+#define FREE_PAGES_HIGH	(2*FREE_PAGES_LOW)
+#define SWAP_SCAN	32
+
+unsigned long get_free_pages(int order)
+{
+	static int balancing = 0;
+	unsigned long page;
+	int tries = 32<<order;
+	int pages;
 
 repeat:
-	__asm__("std ; repne ; scasb\n\t"
-		"jne 1f\n\t"
-		"movb $1,1(%%edi)\n\t"
-		"sall $12,%%ecx\n\t"
-		"addl %2,%%ecx\n\t"
-		"movl %%ecx,%%edx\n\t"
-		"movl $1024,%%ecx\n\t"
-		"leal 4092(%%edx),%%edi\n\t"
-		"rep ; stosl\n\t"
-		"movl %%edx,%%eax\n"
-		"1:"
-		:"=a" (__res)
-		:"0" (0),"i" (LOW_MEM),"c" (PAGING_PAGES),
-		"D" (mem_map+PAGING_PAGES-1)
-		:"di","cx","dx");
-	if (__res >= HIGH_MEMORY)
-		goto repeat;
-	if (!__res && swap_out())
+	if (nr_free_pages < FREE_PAGES_LOW && !balancing) {
+		balancing = 1;
+		pages = FREE_PAGES_HIGH - nr_free_pages;
+		try_to_free_pages(pages,pages*SWAP_SCAN);
+		balancing = 0;
+	}
+	if (page = alloc_pages(order))
+		return page;
+	if (order && --tries < 0)
+		return 0;
+	if (try_to_free_pages(1<<order,
+	    (PAGE_MAX_AGE/PAGE_DECLINE + 1) * PAGING_PAGES))
 		goto repeat;
-	return __res;
+	return 0;
 }
 
-void init_swapping(void)
+unsigned long get_free_page(void)
+{
+	return get_free_pages(0);
+}
+
+static int get_clusters(void)
+{
+	int i;
+
+	for (i = 0 ; i < NR_CLUSTERS ; i++) {
+		if (!(cluster[i].c_data = (char *) get_free_pages(CLUSTER_ORDER)))
+			break;
+		nr_clusters++;
+	}
+	return nr_clusters;
+}
+
+/* puts area 'type' into swap_list, after those of the same priority */
+static void insert_swap_area(int type)
+{
+	int i, prev = -1;
+
+	for (i = swap_list.head ; i >= 0 ; i = swap_info[i].next) {
+		if (swap_info[i].prio < swap_info[type].prio)
+			break;
+		prev = i;
+	}
+	swap_info[type].next = i;
+	if (prev < 0)
+		swap_list.head = type;
+	else
+		swap_info[prev].next = type;
+	swap_list.next = swap_list.head;
+}
+
+/*
+ * add_swap_area() starts swapping to a device, or to a regular file if
+ * 'inode' is set: then the caller's reference to the inode is kept for
+ * as long as the file is used. A swap file mustn't have holes, and it
+ * shouldn't be written to by anybody else, obviously.
+ */
+static int add_swap_area(int dev, struct m_inode * inode, int prio)
 {
 	extern int *blk_size[];
-	int swap_size,i,j;
+	struct swap_info_struct * p;
+	char * header;
+	int b[PAGE_SIZE/BLOCK_SIZE];
+	int type, i, max, size, error;
 
-	if (!SWAP_DEV)
-		return;
-	if (!blk_size[MAJOR(SWAP_DEV)]) {
+	for (type = 0 ; type < MAX_SWAPFILES ; type++)
+		if (!swap_info[type].flags)
+			break;
+	if (type >= MAX_SWAPFILES)
+		return -EPERM;
+	for (i = 0 ; i < MAX_SWAPFILES ; i++)
+		if (swap_info[i].flags && swap_info[i].dev == dev &&
+		    swap_info[i].inode == inode)
+			return -EBUSY;
+	p = swap_info + type;
+	p->flags = SWP_USED;
+	p->dev = dev;
+	p->inode = inode;
+	p->max = 0;
+	p->nr_free = 0;
+	p->hint = 0;
+	p->next = -1;
+	error = -EINVAL;
+	if (inode)
+		max = inode->i_size >> 12;
+	else if (blk_size[MAJOR(dev)])
+		max = blk_size[MAJOR(dev)][MINOR(dev)] >> 2;
+	else {
 		printk("Unable to get size of swap device\n\r");
-		return;
+		goto out;
 	}
-	swap_size = blk_size[MAJOR(SWAP_DEV)][MINOR(SWAP_DEV)];
-	if (!swap_size)
-		return;
-	if (swap_size < 100) {
-		printk("Swap device too small (%d blocks)\n\r",swap_size);
-		return;
+	if (max < 25) {
+		printk("Swap device too small (%d blocks)\n\r",max<<2);
+		goto out;
 	}
-	swap_size >>= 2;
-	if (swap_size > SWAP_BITS)
-		swap_size = SWAP_BITS;
-	swap_bitmap = (char *) get_free_page();
-	if (!swap_bitmap) {
-		printk("Unable to start swapping: out of memory :-)\n\r");
-		return;
-	}
-	read_swap_page(0,swap_bitmap);
-	if (strncmp("SWAP-SPACE",swap_bitmap+4086,10)) {
+	if (max > MAX_SWAP_SLOTS)
+		max = MAX_SWAP_SLOTS;
+	if (inode)
+		for (i = 0 ; i < max*(PAGE_SIZE/BLOCK_SIZE) ; i++)
+			if (!bmap(inode,i)) {
+				printk("Swap file has holes\n\r");
+				goto out;
+			}
+	error = -ENOMEM;
+	if (!(header = (char *) get_free_page()))
+		goto out;
+	if (inode) {
+		for (i = 0 ; i < PAGE_SIZE/BLOCK_SIZE ; i++)
+			b[i] = bmap(inode,i);
+		ll_rw_swap_file(READ,dev,b,i,header);
+	} else
+		ll_rw_page(READ,dev,0,header);
+	error = -EINVAL;
+	if (strncmp("SWAP-SPACE",header+4086,10)) {
 		printk("Unable to find swap-space signature\n\r");
-		free_page((long) swap_bitmap);
-		swap_bitmap = NULL;
-		return;
+		goto out_header;
 	}
-	memset(swap_bitmap+4086,0,10);
+	memset(header+4086,0,10);
 	for (i = 0 ; i < SWAP_BITS ; i++) {
 		if (i == 1)
-			i = swap_size;
-		if (bit(swap_bitmap,i)) {
+			i = max;
+		if (i < SWAP_BITS && bit(header,i)) {
 			printk("Bad swap-space bit-map\n\r");
-			free_page((long) swap_bitmap);
-			swap_bitmap = NULL;
-			return;
+			goto out_header;
 		}
 	}
-	j = 0;
-	for (i = 1 ; i < swap_size ; i++)
-		if (bit(swap_bitmap,i))
-			j++;
-	if (!j) {
-		free_page((long) swap_bitmap);
-		swap_bitmap = NULL;
-		return;
+	size = ((max + 31) >> 5) * 4 + (max + SWAP_CLUSTER - 1) / SWAP_CLUSTER;
+	for (p->order = 0 ; (PAGE_SIZE << p->order) < size ; p->order++)
+		/* nothing */ ;
+	error = -ENOMEM;
+	if (!(p->bitmap = (char *) get_free_pages(p->order)))
+		goto out_header;
+	for (p->map_order = 0 ; (PAGE_SIZE << p->map_order) < max ; p->map_order++)
+		/* nothing */ ;
+	if (!(p->swap_map = (unsigned char *) get_free_pages(p->map_order))) {
+		free_pages((unsigned long) p->bitmap,p->order);
+		p->bitmap = NULL;
+		goto out_header;
+	}
+	p->cluster_free = (unsigned char *) p->bitmap + ((max + 31) >> 5) * 4;
+	for (i = 1 ; i < max ; i++)
+		if (i >= SWAP_BITS || bit(header,i)) {
+			setbit(p->bitmap,i);
+			p->cluster_free[i/SWAP_CLUSTER]++;
+			p->nr_free++;
+		}
+	free_page((long) header);
+	error = -EINVAL;
+	if (!p->nr_free)
+		goto out_bitmap;
+	error = -ENOMEM;
+	if (!nr_clusters && !get_clusters()) {
+		printk("Unable to start swapping: out of memory :-)\n\r");
+		goto out_bitmap;
+	}
+	p->max = max;
+	p->prio = prio;
+	insert_swap_area(type);
+	p->flags = SWP_WRITEOK;
+	printk("Adding swap: %d pages (%d bytes) swap-space, priority %d\n\r",
+		p->nr_free,p->nr_free*4096,prio);
+	return 0;
+out_bitmap:
+	free_pages((unsigned long) p->swap_map,p->map_order);
+	free_pages((unsigned long) p->bitmap,p->order);
+	p->swap_map = NULL;
+	p->bitmap = NULL;
+	goto out;
+out_header:
+	free_page((long) header);
+out:
+	p->inode = NULL;
+	p->flags = 0;
+	return error;
+}
+
+void init_swapping(void)
+{
+	zswap_init();
+	ksm_init();
+	if (SWAP_DEV)
+		add_swap_area(SWAP_DEV,NULL,--least_priority);
+}
+
+int sys_swapon(const char * specialfile, int swap_flags)
+{
+	struct m_inode * inode;
+	int dev, prio, error;
+
+	if (!suser())
+		return -EPERM;
+	if (!(inode = namei(specialfile)))
+		return -ENOENT;
+	if (S_ISBLK(inode->i_mode)) {
+		dev = inode->i_zone[0];
+		iput(inode);
+		inode = NULL;
+	} else if (S_ISREG(inode->i_mode))
+		dev = inode->i_dev;
+	else {
+		iput(inode);
+		return -EINVAL;
+	}
+	if (swap_flags & SWAP_FLAG_PREFER)
+		prio = swap_flags & SWAP_FLAG_PRIO_MASK;
+	else
+		prio = --least_priority;
+	if ((error = add_swap_area(dev,inode,prio)) && inode)
+		iput(inode);
+	return error;
+}
+
+/*
+ * unuse_entry() swaps in a page for swapoff(), in a page table of some
+ * other task. The table is held on to, as the task may go away while we
+ * sleep: if it has, what we brought in goes again.
+ */
+static int unuse_entry(unsigned long * table_ptr)
+{
+	unsigned long table = 0xfffff000 & (unsigned long) table_ptr;
+	int ok;
+
+	mem_map[MAP_NR(table)]++;
+	ok = swap_in_page(table_ptr);
+	if (mem_map[MAP_NR(table)] == 1 && *table_ptr) {
+		if (1 & *table_ptr)
+			free_page(0xfffff000 & *table_ptr);
+		else
+			swap_free(*table_ptr >> 1);
+		*table_ptr = 0;
+	}
+	free_page(table);
+	return ok;
+}
+
+/*
+ * Brings in all pages that are in area 'type'. We may sleep for each,
+ * after which the page tables may look different: the entry is looked
+ * at again, or the whole table if it isn't the same one any more, or
+ * the next task if this one has gone or exec'ed. A page that has moved
+ * behind us meanwhile is found by the pass that follows. Returns 0 if
+ * there wasn't memory for them all.
+ */
+static int try_to_unuse(int type)
+{
+	struct task_struct * p;
+	unsigned long * dir, * table, entry;
+	int nr, i, j, again;
+
+repeat:
+	again = 0;
+	for (nr = 1 ; nr < NR_TASKS ; nr++) {
+		if (!(p = task[nr]))
+			continue;
+		dir = (unsigned long *) p->tss.cr3;
+		for (i = FIRST_VM_PAGE>>10 ; i < LAST_VM_PAGE>>10 ; i++) {
+			if (!(1 & dir[i]))
+				continue;
+			table = (unsigned long *) (0xfffff000 & dir[i]);
+			for (j = 0 ; j < 1024 ; j++) {
+				entry = table[j];
+				if (!entry || (1 & entry) || SWP_TYPE(entry >> 1) != type)
+					continue;
+				if (!unuse_entry(table + j))
+					return 0;
+				again = 1;
+				if (task[nr] != p || p->tss.cr3 != (unsigned long) dir)
+					goto next_task;
+				if ((0xfffff000 & dir[i]) != (unsigned long) table) {
+					i--;
+					break;
+				}
+				j--;
+			}
+		}
+next_task:
+		;
 	}
-	printk("Swap device ok: %d pages (%d bytes) swap-space\n\r",j,j*4096);
+	if (again)
+		goto repeat;
+	return 1;
+}
+
+int sys_swapoff(const char * specialfile)
+{
+	struct swap_info_struct * p;
+	struct m_inode * inode;
+	int type, prev = -1, i;
+
+	if (!suser())
+		return -EPERM;
+	if (!(inode = namei(specialfile)))
+		return -ENOENT;
+	for (type = swap_list.head ; type >= 0 ; type = p->next) {
+		p = swap_info + type;
+		if (p->inode ? p->inode == inode :
+		    S_ISBLK(inode->i_mode) && p->dev == inode->i_zone[0])
+			break;
+		prev = type;
+	}
+	iput(inode);
+	if (type < 0)
+		return -EINVAL;
+	if (prev < 0)
+		swap_list.head = p->next;
+	else
+		swap_info[prev].next = p->next;
+	swap_list.next = swap_list.head;
+	p->flags = SWP_USED;
+/* batches take their slots with a cluster locked: wait for those going on */
+	for (i = 0 ; i < nr_clusters ; i++)
+		while (cluster[i].c_lock)
+			sleep_on(&cluster[i].c_wait);
+	if (!try_to_unuse(type)) {
+		insert_swap_area(type);
+		p->flags = SWP_WRITEOK;
+		return -ENOMEM;
+	}
+	free_pages((unsigned long) p->swap_map,p->map_order);
+	free_pages((unsigned long) p->bitmap,p->order);
+	if (p->inode)
+		iput(p->inode);
+	p->swap_map = NULL;
+	p->bitmap = NULL;
+	p->inode = NULL;
+	p->max = 0;
+	p->flags = 0;
+	return 0;
+}
+
+void show_swap(void)
+{
+	struct swap_info_struct * p;
+
+	show_zswap();
+	for (p = swap_info ; p < swap_info + MAX_SWAPFILES ; p++)
+		if (p->flags == SWP_WRITEOK)
+			printk("Swap %04x%s: %d of %d pages free, priority %d\n\r",
+				p->dev,p->inode ? " (file)" : "",
+				p->nr_free,p->max - 1,p->prio);
 }
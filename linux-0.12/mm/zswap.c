@@ -0,0 +1,299 @@
+/*
+ *  linux/mm/zswap.c
+ *
+ *  (C) 1991  Linus Torvalds
+ */
+
+/*
+ * zswap.c keeps swapped-out pages compressed in memory, in front of the
+ * swap devices. swap_out() tries zswap_store() first: only a page that
+ * doesn't compress to ZSWAP_MAX_LEN, or that doesn't fit in the pool any
+ * more, goes to disk. A page compresses to a third or so, so memory is
+ * still freed, and getting it back costs no disk access at all.
+ *
+ * The pool is ZSWAP_PERCENT of memory at most. Compressed pages are put
+ * in the pool pages one after the other, and a pool page goes back when
+ * the last one in it is gone. The pool never allocates: when it needs a
+ * new page, it takes the page that is being swapped out, whose contents
+ * are safely compressed by then. So this works even when there is no
+ * free memory at all, which is when it's needed.
+ *
+ * The compression is a simple LZ77: a 16-bit word of flags for each 16
+ * items, and an item is a literal byte, or two bytes of match: 12 bits
+ * of offset back and 4 bits of length-3. A hash of the next three bytes
+ * finds a match candidate, which is simply checked.
+ */
+
+#include <string.h>
+
+#include <linux/config.h>
+#include <linux/sched.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+
+#if ZSWAP_PERCENT
+
+#define ZSWAP_MAX_LEN	(3*PAGE_SIZE/4)
+#define ZSWAP_HDR	4		/* the count of pages in a pool page */
+#define zlive(page)	(*(unsigned long *) (page))
+
+#define LZ_HASH_BITS	12
+#define LZ_HASH(p) \
+	(((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) * 2654435761U >> (32-LZ_HASH_BITS)) \
+	& ((1<<LZ_HASH_BITS)-1))
+#define LZ_MIN		3
+#define LZ_MAX		(LZ_MIN+15)
+
+struct zentry {
+	unsigned long z_addr;		/* the data, or the next free entry */
+	unsigned short z_len;		/* 0 if free */
+	unsigned short z_count;		/* page tables that have it */
+};
+
+static struct zentry * ztable = NULL;
+static int nr_zentries = 0;
+static int free_zentry = 0;
+static unsigned long zpage = 0;		/* the pool page being filled */
+static int zpage_used = 0;
+static int nr_zpages = 0;
+static int max_zpages = 0;
+static int nr_stored = 0;
+static int nr_rejected = 0;
+
+static unsigned short lz_hash[1<<LZ_HASH_BITS];
+static unsigned char zbuf[ZSWAP_MAX_LEN];
+
+/*
+ * Compresses a page into 'out'. Returns the length, or 0 if it would be
+ * more than 'max'. The hash table isn't cleared between pages: what was
+ * left in it points somewhere into this page too, and gets checked.
+ */
+static int lz_compress(unsigned char * in, unsigned char * out, int max)
+{
+	unsigned char * ip = in, * end = in + PAGE_SIZE, * op = out;
+	unsigned char * ctrl, * cand;
+	unsigned int bits = 0, h;
+	int nbits = 0, len, off;
+
+	ctrl = op;
+	op += 2;
+	while (ip < end) {
+		if (nbits == 16) {
+			ctrl[0] = bits;
+			ctrl[1] = bits >> 8;
+			ctrl = op;
+			op += 2;
+			bits = 0;
+			nbits = 0;
+		}
+		if (op + 4 > out + max)
+			return 0;
+		if (end - ip >= LZ_MIN) {
+			h = LZ_HASH(ip);
+			cand = in + lz_hash[h];
+			lz_hash[h] = ip - in;
+			if (cand < ip && cand[0] == ip[0] && cand[1] == ip[1] &&
+			    cand[2] == ip[2]) {
+				for (len = LZ_MIN ; len < LZ_MAX && ip + len < end &&
+				    cand[len] == ip[len] ; len++)
+					/* nothing */ ;
+				off = ip - cand;
+				*op++ = off;
+				*op++ = ((off >> 8) & 0x0f) | ((len - LZ_MIN) << 4);
+				bits |= 1 << nbits++;
+				ip += len;
+				continue;
+			}
+		}
+		*op++ = *ip++;
+		nbits++;
+	}
+	ctrl[0] = bits;
+	ctrl[1] = bits >> 8;
+	return op - out;
+}
+
+static void lz_decompress(unsigned char * in, int len, unsigned char * out)
+{
+	unsigned char * end = in + len, * cand;
+	unsigned int bits = 0;
+	int nbits = 0, n;
+
+	while (in < end) {
+		if (!nbits) {
+			bits = in[0] | (in[1] << 8);
+			in += 2;
+			nbits = 16;
+			continue;
+		}
+		if (bits & 1) {
+			cand = out - (in[0] | ((in[1] & 0x0f) << 8));
+			n = (in[1] >> 4) + LZ_MIN;
+			in += 2;
+			while (n-- > 0)
+				*out++ = *cand++;
+		} else
+			*out++ = *in++;
+		bits >>= 1;
+		nbits--;
+	}
+}
+
+/*
+ * zswap_store() compresses a page that is being swapped out. Returns the
+ * number of its entry, or 0 if it has to go to disk after all. If the
+ * page was stored, '*freed' says if it was freed too: it may have become
+ * part of the pool instead. Doesn't sleep.
+ */
+int zswap_store(unsigned long page, int * freed)
+{
+	struct zentry * e;
+	int len, nr;
+
+	*freed = 0;
+	if (!free_zentry)
+		return 0;
+	if (!(len = lz_compress((unsigned char *) page,zbuf,ZSWAP_MAX_LEN))) {
+		nr_rejected++;
+		return 0;
+	}
+	if (!zpage || zpage_used + len > PAGE_SIZE) {
+		if (nr_zpages >= max_zpages)
+			return 0;
+		if (zpage && !zlive(zpage)) {
+			free_page(zpage);
+			nr_zpages--;
+		}
+		zpage = page;
+		zpage_used = ZSWAP_HDR;
+		zlive(zpage) = 0;
+		nr_zpages++;
+	} else {
+		free_page(page);
+		*freed = 1;
+	}
+	nr = free_zentry;
+	e = ztable + nr;
+	free_zentry = e->z_addr;
+	e->z_addr = zpage + zpage_used;
+	e->z_len = len;
+	e->z_count = 1;
+	memcpy((char *) e->z_addr,zbuf,len);
+	zpage_used += (len + 3) & ~3;
+	zlive(zpage)++;
+	nr_stored++;
+	return nr;
+}
+
+void zswap_free(int nr)
+{
+	struct zentry * e;
+	unsigned long page;
+
+	if (nr <= 0 || nr >= nr_zentries || !(e = ztable + nr)->z_len) {
+		printk("zswap_free: bad entry %d\n\r",nr);
+		return;
+	}
+	if (--e->z_count)
+		return;
+	page = e->z_addr & 0xfffff000;
+	e->z_len = 0;
+	e->z_addr = free_zentry;
+	free_zentry = nr;
+	nr_stored--;
+	if (--zlive(page))
+		return;
+	if (page == zpage)
+		zpage_used = ZSWAP_HDR;
+	else {
+		free_page(page);
+		nr_zpages--;
+	}
+}
+
+/* a copy of a page table has the entry too: see un_wp_table() */
+void zswap_duplicate(int nr)
+{
+	if (nr <= 0 || nr >= nr_zentries || !ztable[nr].z_len) {
+		printk("zswap_duplicate: bad entry %d\n\r",nr);
+		return;
+	}
+	ztable[nr].z_count++;
+}
+
+/* uncompresses the page of entry 'nr' into 'page', and frees the entry */
+void zswap_load(int nr, char * page)
+{
+	struct zentry * e = ztable + nr;
+
+	if (nr <= 0 || nr >= nr_zentries || !e->z_len) {
+		printk("zswap_load: bad entry %d\n\r",nr);
+		return;
+	}
+	lz_decompress((unsigned char *) e->z_addr,e->z_len,(unsigned char *) page);
+	zswap_free(nr);
+}
+
+void zswap_init(void)
+{
+	int order, i;
+
+/* an entry for each page, if the table fits in one block */
+	nr_zentries = PAGING_PAGES;
+	if (nr_zentries > (PAGE_SIZE << (NR_MEM_ORDERS-1)) / sizeof(struct zentry))
+		nr_zentries = (PAGE_SIZE << (NR_MEM_ORDERS-1)) / sizeof(struct zentry);
+	for (order = 0 ; (PAGE_SIZE << order) < nr_zentries*sizeof(struct zentry) ;
+	    order++)
+		/* nothing */ ;
+	if (!(ztable = (struct zentry *) get_free_pages(order))) {
+		printk("Unable to start compressed swapping\n\r");
+		nr_zentries = 0;
+		return;
+	}
+/* entry 0 isn't used: a swap entry is never 0 */
+	for (i = nr_zentries ; --i > 0 ; ) {
+		ztable[i].z_addr = free_zentry;
+		free_zentry = i;
+	}
+	max_zpages = PAGING_PAGES * ZSWAP_PERCENT / 100;
+	printk("Compressed swap: up to %d pages\n\r",max_zpages);
+}
+
+void show_zswap(void)
+{
+	if (ztable)
+		printk("Compressed swap: %d pages in %d, %d didn't compress\n\r",
+			nr_stored,nr_zpages,nr_rejected);
+}
+
+#else
+
+int zswap_store(unsigned long page, int * freed)
+{
+	return 0;
+}
+
+void zswap_free(int nr)
+{
+	printk("zswap_free: bad entry %d\n\r",nr);
+}
+
+void zswap_duplicate(int nr)
+{
+	printk("zswap_duplicate: bad entry %d\n\r",nr);
+}
+
+void zswap_load(int nr, char * page)
+{
+	printk("zswap_load: bad entry %d\n\r",nr);
+}
+
+void zswap_init(void)
+{
+}
+
+void show_zswap(void)
+{
+}
+
+#endif